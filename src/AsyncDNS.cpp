@@ -26,31 +26,125 @@
 
 #include "AsyncDNS.h"	// Interface declaration
 
+#include <wx/thread.h>
+
+#include <deque>
+#include <map>
+#include <vector>
+
 #include "InternalEvents.h"	// Needed for wxEVT_*
 #include "NetworkFunctions.h" // Needed for StringHosttoUint32
+#include "GetTickCount.h"	// Needed for GetTickCount64
 #include "Logger.h"
 
 
-CAsyncDNS::CAsyncDNS(const wxString& ipName, DnsSolveType type, wxEvtHandler* handler, void* socket)
-	: wxThread(wxTHREAD_DETACHED)
+// Maximum number of names resolved at the same time
+static const uint32 DNS_THREADS = 4;
+// How long resolved names are reused, in ms
+static const uint32 DNS_CACHE_TIME = 5*60*1000;
+// How long failures are remembered, in ms
+static const uint32 DNS_NEGATIVE_CACHE_TIME = 60*1000;
+// Upper limit of cached names
+static const uint32 DNS_CACHE_SIZE = 1024;
+
+
+struct DNSRequest
 {
-	m_type = type;
-	m_ipName = ipName.wc_str();		// make a deep copy to to circument the thread-unsafe wxString reference counting
-	m_socket = socket;
-	m_handler = handler;
-}
+	DnsSolveType	type;
+	wxEvtHandler*	handler;
+	void*		socket;
+};
+
+
+struct DNSCacheEntry
+{
+	uint32	ip;
+	uint64	expires;
+};
+
+
+/**
+ * State shared by the resolver threads. It is reference counted, because
+ * a thread stuck in a lookup may outlive CAsyncDNS::Terminate().
+ */
+class CDNSResolver
+{
+public:
+	CDNSResolver()
+		: m_condition(m_mutex),
+		  m_refs(1),
+		  m_threads(0),
+		  m_idleThreads(0),
+		  m_terminated(false),
+		  m_lookups(0),
+		  m_cacheHits(0),
+		  m_merged(0),
+		  m_failures(0),
+		  m_resolved(0),
+		  m_totalLatency(0)
+	{
+	}
+
+	void Release()
+	{
+		bool last;
+		{
+			wxMutexLocker lock(m_mutex);
+			last = --m_refs == 0;
+		}
+		if (last) {
+			delete this;
+		}
+	}
+
+	//! Removes expired entries, or everything if that doesn't make room
+	void PruneCache(uint64 now)
+	{
+		for (CacheMap::iterator it = m_cache.begin(); it != m_cache.end();) {
+			if (it->second.expires <= now) {
+				m_cache.erase(it++);
+			} else {
+				++it;
+			}
+		}
+		if (m_cache.size() >= DNS_CACHE_SIZE) {
+			m_cache.clear();
+		}
+	}
+
+	typedef std::map<wxString, std::vector<DNSRequest> > RequestMap;
+	typedef std::map<wxString, DNSCacheEntry> CacheMap;
 
+	wxMutex		m_mutex;
+	wxCondition	m_condition;
+	uint32		m_refs;
+	uint32		m_threads;
+	uint32		m_idleThreads;
+	bool		m_terminated;
+	//! Names waiting for a thread
+	std::deque<wxString>	m_queue;
+	//! Requests by name, for names queued or being resolved
+	RequestMap	m_pending;
+	CacheMap	m_cache;
 
-wxThread::ExitCode CAsyncDNS::Entry()
+	uint64		m_lookups;
+	uint64		m_cacheHits;
+	uint64		m_merged;
+	uint64		m_failures;
+	uint64		m_resolved;
+	uint64		m_totalLatency;
+};
+
+
+static void PostResult(const DNSRequest& request, uint32 ip)
 {
-	uint32 result = StringHosttoUint32(m_ipName);
 	uint32 event_id = 0;
 	void* event_data = NULL;
 
-	switch (m_type) {
+	switch (request.type) {
 		case DNS_UDP:
 			event_id = wxEVT_CORE_UDP_DNS_DONE;
-			event_data = m_socket;
+			event_data = request.socket;
 			break;
 		case DNS_SOURCE:
 			event_id = wxEVT_CORE_SOURCE_DNS_DONE;
@@ -58,7 +152,7 @@ wxThread::ExitCode CAsyncDNS::Entry()
 			break;
 		case DNS_SERVER_CONNECT:
 			event_id = wxEVT_CORE_SERVER_DNS_DONE;
-			event_data = m_socket;
+			event_data = request.socket;
 			break;
 		default:
 			AddLogLineN(wxT("WRONG TYPE ID ON ASYNC DNS SOLVING!!!"));
@@ -66,11 +160,216 @@ wxThread::ExitCode CAsyncDNS::Entry()
 
 	if (event_id) {
 		CMuleInternalEvent evt(event_id);
-		evt.SetExtraLong(result);
+		evt.SetExtraLong(ip);
 		evt.SetClientData(event_data);
-		wxPostEvent(m_handler,evt);
+		wxPostEvent(request.handler, evt);
+	}
+}
+
+
+class CDNSResolverThread : public wxThread
+{
+public:
+	CDNSResolverThread(CDNSResolver* resolver)
+		: wxThread(wxTHREAD_DETACHED),
+		  m_resolver(resolver)
+	{
+	}
+
+private:
+	ExitCode Entry()
+	{
+		CDNSResolver& r = *m_resolver;
+
+		r.m_mutex.Lock();
+		while (!r.m_terminated) {
+			if (r.m_queue.empty()) {
+				r.m_idleThreads++;
+				r.m_condition.Wait();
+				r.m_idleThreads--;
+				continue;
+			}
+
+			// make a deep copy to to circument the thread-unsafe wxString reference counting
+			const wxString name(r.m_queue.front().wc_str());
+			r.m_queue.pop_front();
+			r.m_mutex.Unlock();
+
+			uint64 start = GetTickCount64();
+			uint32 ip = StringHosttoUint32(name);
+			uint64 now = GetTickCount64();
+
+			r.m_mutex.Lock();
+			if (r.m_terminated) {
+				break;
+			}
+
+			r.m_resolved++;
+			r.m_totalLatency += now - start;
+			if (!ip) {
+				r.m_failures++;
+			}
+
+			if (r.m_cache.size() >= DNS_CACHE_SIZE) {
+				r.PruneCache(now);
+			}
+			DNSCacheEntry& entry = r.m_cache[name];
+			entry.ip = ip;
+			entry.expires = now + (ip ? DNS_CACHE_TIME : DNS_NEGATIVE_CACHE_TIME);
+
+			std::vector<DNSRequest> requests;
+			CDNSResolver::RequestMap::iterator it = r.m_pending.find(name);
+			if (it != r.m_pending.end()) {
+				std::swap(requests, it->second);
+				r.m_pending.erase(it);
+			}
+			r.m_mutex.Unlock();
+
+			for (std::vector<DNSRequest>::iterator req = requests.begin(); req != requests.end(); ++req) {
+				PostResult(*req, ip);
+			}
+
+			r.m_mutex.Lock();
+		}
+		r.m_mutex.Unlock();
+
+		r.Release();
+
+		return NULL;
 	}
 
-	return NULL;
+	CDNSResolver* m_resolver;
+};
+
+
+// Created on the first lookup
+static CDNSResolver* s_resolver = NULL;
+static bool s_terminated = false;
+static wxMutex s_resolverMutex;
+
+
+bool CAsyncDNS::Resolve(const wxString& ipName, DnsSolveType type, wxEvtHandler* handler, void* socket)
+{
+	DNSRequest request = { type, handler, socket };
+	// make a deep copy to to circument the thread-unsafe wxString reference counting
+	const wxString name(ipName.Lower().wc_str());
+
+	wxMutexLocker resolverLock(s_resolverMutex);
+	if (s_resolver == NULL) {
+		if (s_terminated) {
+			return false;
+		}
+		s_resolver = new CDNSResolver();
+	}
+	CDNSResolver& r = *s_resolver;
+
+	wxMutexLocker lock(r.m_mutex);
+	r.m_lookups++;
+
+	CDNSResolver::CacheMap::iterator cached = r.m_cache.find(name);
+	if (cached != r.m_cache.end()) {
+		if (cached->second.expires > GetTickCount64()) {
+			r.m_cacheHits++;
+			PostResult(request, cached->second.ip);
+			return true;
+		}
+		r.m_cache.erase(cached);
+	}
+
+	CDNSResolver::RequestMap::iterator pending = r.m_pending.find(name);
+	if (pending != r.m_pending.end()) {
+		r.m_merged++;
+		pending->second.push_back(request);
+		return true;
+	}
+
+	if (r.m_idleThreads == 0 && r.m_threads < DNS_THREADS) {
+		CDNSResolverThread* thread = new CDNSResolverThread(s_resolver);
+		if (thread->Create() == wxTHREAD_NO_ERROR) {
+			// The thread may finish before Run() returns
+			r.m_refs++;
+			if (thread->Run() == wxTHREAD_NO_ERROR) {
+				r.m_threads++;
+			} else {
+				r.m_refs--;
+				thread->Delete();
+			}
+		} else {
+			thread->Delete();
+		}
+
+		if (r.m_threads == 0) {
+			return false;
+		}
+	}
+
+	r.m_pending[name].push_back(request);
+	r.m_queue.push_back(name);
+	r.m_condition.Signal();
+
+	return true;
+}
+
+
+void CAsyncDNS::Terminate()
+{
+	wxMutexLocker resolverLock(s_resolverMutex);
+	s_terminated = true;
+
+	if (s_resolver) {
+		{
+			wxMutexLocker lock(s_resolver->m_mutex);
+			s_resolver->m_terminated = true;
+			s_resolver->m_queue.clear();
+			s_resolver->m_pending.clear();
+			s_resolver->m_condition.Broadcast();
+		}
+		s_resolver->Release();
+		s_resolver = NULL;
+	}
+}
+
+
+static uint64 GetStatistic(uint64 CDNSResolver::* value)
+{
+	wxMutexLocker resolverLock(s_resolverMutex);
+	if (s_resolver == NULL) {
+		return 0;
+	}
+
+	wxMutexLocker lock(s_resolver->m_mutex);
+	return s_resolver->*value;
+}
+
+
+uint64 CAsyncDNS::GetLookups()
+{
+	return GetStatistic(&CDNSResolver::m_lookups);
+}
+
+
+uint64 CAsyncDNS::GetCacheHits()
+{
+	return GetStatistic(&CDNSResolver::m_cacheHits);
+}
+
+
+uint64 CAsyncDNS::GetMergedLookups()
+{
+	return GetStatistic(&CDNSResolver::m_merged);
+}
+
+
+uint64 CAsyncDNS::GetFailures()
+{
+	return GetStatistic(&CDNSResolver::m_failures);
+}
+
+
+double CAsyncDNS::GetAverageLatency()
+{
+	uint64 resolved = GetStatistic(&CDNSResolver::m_resolved);
+
+	return resolved ? (double)GetStatistic(&CDNSResolver::m_totalLatency) / resolved : 0.0;
 }
 // File_checked_for_headers
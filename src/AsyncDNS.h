@@ -28,9 +28,10 @@
 #define ASYNCDNS_H
 
 #include <wx/string.h>
-#include <wx/thread.h>
 
-// Implementation of Asynchronous dns resolving using wxThread
+#include "Types.h"	// Needed for uint32 and uint64
+
+// Implementation of Asynchronous dns resolving using a pool of wxThreads
 //	 and internal wxIPV4address handling of dns
 
 class wxEvtHandler;
@@ -46,17 +47,49 @@ enum DnsSolveType {
 #define DNS_SOLVE_TIME 30*60*1000
 
 
-class CAsyncDNS : public wxThread
+/**
+ * Resolves host names in the background.
+ *
+ * Lookups are handed to a small pool of threads shared by all users. A
+ * lookup of a name that is already being resolved is merged with it, and
+ * results are cached for a few minutes (failures for a shorter while), so
+ * bursts of lookups like those from a server.met or a batch of ed2k links
+ * don't cost a thread or a query each.
+ *
+ * The result is posted to the handler as a CMuleInternalEvent of the type
+ * belonging to the DnsSolveType, with the IP (0 on failure) as extra long
+ * and the socket as client data. This happens even for cached results, so
+ * callers always get the answer asynchronously.
+ */
+class CAsyncDNS
 {
 public:
-	CAsyncDNS(const wxString& ipName, DnsSolveType type, wxEvtHandler* handler, void* socket = NULL);
-	virtual ExitCode Entry();
+	/**
+	 * Starts resolving a host name.
+	 *
+	 * @return False if the lookup couldn't be started, no event is posted then.
+	 */
+	static bool Resolve(const wxString& ipName, DnsSolveType type, wxEvtHandler* handler, void* socket = NULL);
+
+	/**
+	 * Drops all pending lookups and stops the threads, on shutdown.
+	 * Lookups requested afterwards fail.
+	 */
+	static void Terminate();
+
+	//! Number of lookups requested
+	static uint64 GetLookups();
+	//! Number of lookups answered from the cache
+	static uint64 GetCacheHits();
+	//! Number of lookups merged with a pending one
+	static uint64 GetMergedLookups();
+	//! Number of names that couldn't be resolved
+	static uint64 GetFailures();
+	//! Average time a name took to resolve, in milliseconds
+	static double GetAverageLatency();
 
 private:
-	DnsSolveType m_type;
-	wxString m_ipName;
-	void* m_socket;
-	wxEvtHandler* m_handler;
+	CAsyncDNS();
 };
 
 #endif // ASYNCDNS_H
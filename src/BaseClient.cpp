@@ -54,6 +54,7 @@
 #include "SearchList.h"		// Needed for CSearchList
 #include "DownloadQueue.h"	// Needed for CDownloadQueue
 #include "UploadQueue.h"	// Needed for CUploadQueue
+#include "DownloadBandwidthThrottler.h"	// Needed for DownloadBandwidthThrottler
 #include "IPFilter.h"		// Needed for CIPFilter
 #include "ServerConnect.h"	// Needed for CServerConnect
 #include "ClientCredits.h"	// Needed for CClientCredits
@@ -2419,7 +2420,7 @@ bool CUpDownClient::SendPacket(CPacket* packet, bool delpacket, bool controlpack
 	}
 }
 
-float CUpDownClient::SetDownloadLimit(uint32 reducedownload)
+float CUpDownClient::SetDownloadPriority(uint8 priority)
 {
 	// lfroen: in daemon it actually can happen
 		wxASSERT( m_socket );
@@ -2427,32 +2428,10 @@ float CUpDownClient::SetDownloadLimit(uint32 reducedownload)
 	float kBpsClient = CalculateKBpsDown();
 
 	if ( m_socket ) {
-
-		if (reducedownload) {
-			// (% to reduce * current speed) / 100 and THEN, / (1000 / CORE_TIMER_PERIOD)
-			// which is how often it is called per second.
-			uint32 limit = (uint32)(reducedownload * kBpsClient * 1024.0 / 100000.0 * CORE_TIMER_PERIOD);
-
-			if(limit<1024 && reducedownload >= 200) {
-				// If we're going up and this download is < 1kB,
-				// we want it to go up fast. Can be reduced later,
-				// and it'll probably be in a more fair way with
-				// other downloads that are faster.
-				limit +=1024;
-			} else if(limit == 0) {
-				// This download is not transferring yet... make it
-				// 1024 so we don't fill the TCP stack and lose the
-				// connection.
-				limit = 1024;
-			}
-
-			m_socket->SetDownloadLimit(limit);
-		} else {
-			m_socket->DisableDownloadLimit();
-		}
-
+		// The throttler hands out the receive budgets from now on
+		theApp->downloadBandwidthThrottler->AddToStandardList(m_socket, priority);
 	} else {
-		AddLogLineNS(CFormat(wxT("CAUGHT DEAD SOCKET IN SETDOWNLOADLIMIT() WITH SPEED %f")) % kBpsClient);
+		AddLogLineNS(CFormat(wxT("CAUGHT DEAD SOCKET IN SETDOWNLOADPRIORITY() WITH SPEED %f")) % kBpsClient);
 	}
 
 	return kBpsClient;
@@ -130,6 +130,7 @@ uint8				WRAPC(GetDownloadState)
 CFriend*			WRAPC(GetFriend)
 bool				WRAPC(GetFriendSlot)
 wxString			WRAPC(GetFullIP)
+uint32				WRAPC(GetFullUserIP)
 uint32				WRAPC(GetIP)
 uint16				WRAPC(GetKadPort)
 float				WRAPC(GetKBpsDown)
@@ -127,6 +127,7 @@ public:
 	CFriend*			GetFriend() const;
 	bool				GetFriendSlot() const;
 	wxString			GetFullIP() const;
+	uint32				GetFullUserIP() const;
 	uint16				GetKadPort() const;
 	float				GetKBpsDown() const;
 	uint32				GetIP() const;
@@ -180,16 +180,9 @@ bool CClientTCPSocket::InitNetworkData()
 
 	MULE_CHECK(m_remoteip, false);
 
-	if (theApp->ipfilter->IsFiltered(m_remoteip)) {
-		AddDebugLogLineN(logClient, wxT("Denied connection from ") + GetPeer() + wxT("(Filtered IP)"));
-		return false;
-	} else if (theApp->clientlist->IsBannedClient(m_remoteip)) {
-		AddDebugLogLineN(logClient, wxT("Denied connection from ") + GetPeer() + wxT("(Banned IP)"));
-		return false;
-	} else {
-		AddDebugLogLineN(logClient, wxT("Accepted connection from ") + GetPeer());
-		return true;
-	}
+	// Filtered and banned IPs were turned away by CListenSocket::AdmitConnection
+	AddDebugLogLineN(logClient, wxT("Accepted connection from ") + GetPeer());
+	return true;
 }
 
 void CClientTCPSocket::ResetTimeOutTimer()
@@ -29,7 +29,8 @@
 
 #include "updownclient.h"		// Needed for CUpDownClient
 
-#define	CLEANUPTIME			MIN2MS(60)
+//! The resolution of the timeouts, entries are removed up to this much later.
+#define TIMEOUT_RESOLUTION	MIN2MS(1)
 
 #define BLOCKTIME		(::GetTickCount() + (m_bGlobalList ? MIN2MS(30) : MIN2MS(45)))
 #define BLOCKTIMEFW		(::GetTickCount() + (m_bGlobalList ? MIN2MS(45) : MIN2MS(60)))
@@ -80,8 +81,8 @@ bool CDeadSourceList::CDeadSource::operator==(const CDeadSource& other) const
 //// CDeadSourceList
 
 CDeadSourceList::CDeadSourceList(bool isGlobal)
+	: m_timeouts(TIMEOUT_RESOLUTION, ::GetTickCount())
 {
-	m_dwLastCleanUp = ::GetTickCount();
 	m_bGlobalList = isGlobal;
 }
 
@@ -132,6 +133,12 @@ void CDeadSourceList::AddDeadSource( const CUpDownClient* client )
 	// Set the timeout for the new source
 	source.SetTimeout( client->HasLowID() ? BLOCKTIMEFW : BLOCKTIME );
 
+	// Drop the expired entries first, to avoid a buildup of stale entries
+	CleanUp();
+
+	// The old timeout of a listed source is simply ignored when it expires
+	m_timeouts.Add( client->GetUserIDHybrid(), source.GetTimeout() );
+
 	// Check if the source is already listed
 	DeadSourcePair range = m_sources.equal_range( client->GetUserIDHybrid() );
 	for ( ; range.first != range.second; range.first++ ) {
@@ -142,24 +149,25 @@ void CDeadSourceList::AddDeadSource( const CUpDownClient* client )
 	}
 
 	m_sources.insert( DeadSourceMap::value_type( client->GetUserIDHybrid(), source ) );
-
-	// Check if we should cleanup the list. This is
-	// done to avoid a buildup of stale entries.
-	if ( GetTickCount() - m_dwLastCleanUp > CLEANUPTIME ) {
-		CleanUp();
-	}
 }
 
 
 void CDeadSourceList::CleanUp()
 {
-	m_dwLastCleanUp = ::GetTickCount();
-
-	DeadSourceIterator it = m_sources.begin();
-	for ( ; it != m_sources.end(); ) {
-		DeadSourceIterator it1 = it++;
-		if ( it1->second.GetTimeout() < m_dwLastCleanUp ) {
-			m_sources.erase( it1 );
+	uint32 now = ::GetTickCount();
+
+	std::vector<uint32> expired;
+	m_timeouts.Expire( now, expired );
+
+	// An ID may be listed several times, with later timeouts for some entries
+	std::vector<uint32>::iterator itID = expired.begin();
+	for ( ; itID != expired.end(); ++itID ) {
+		DeadSourcePair range = m_sources.equal_range( *itID );
+		for ( ; range.first != range.second; ) {
+			DeadSourceIterator it1 = range.first++;
+			if ( it1->second.GetTimeout() <= now ) {
+				m_sources.erase( it1 );
+			}
 		}
 	}
 }
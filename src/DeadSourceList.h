@@ -30,6 +30,7 @@
 #include <map>
 
 #include "Types.h"
+#include "TimerWheel.h"
 
 
 class CUpDownClient;
@@ -76,7 +77,10 @@ public:
 
 private:
 	/**
-	 * Removes too old entries from the list.
+	 * Removes the entries whose timeout has passed.
+	 *
+	 * Only the IDs whose timeouts are due are looked at, so this is
+	 * cheap enough to be done whenever a source is added.
 	 */
 	void		CleanUp();
 
@@ -141,8 +145,8 @@ private:
 	DeadSourceMap m_sources;
 
 
-	//! The timestamp of when the last cleanup was performed.
-	uint32	m_dwLastCleanUp;
+	//! The IDs of the entries, by timeout.
+	CTimerWheel<uint32> m_timeouts;
 	//! Specifies if the list is global or not.
 	bool	m_bGlobalList;
 };
@@ -0,0 +1,255 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2005-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+// Copyright (c) 2002-2011 Merkur ( devs@emule-project.net / http://www.emule-project.net )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "DownloadBandwidthThrottler.h"
+
+#include <common/Macros.h>
+#include <common/Constants.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Constants.h"		// Needed for PR_*
+#include "GetTickCount.h"
+#include "ThrottledSocket.h"
+#include "Preferences.h"
+
+
+// Number of passes over the hungry sockets per cycle. Each pass redistributes
+// what the sockets of the previous pass left over.
+static const uint32 MAX_ROUNDS_PER_CYCLE = 3;
+// Never hand out less than this, or a low limit shared by many sources would
+// be chopped into useless single-byte reads.
+static const uint32 MIN_GRANT_SIZE = 536;
+
+
+/**
+ * The constructor doesn't start any thread, the throttler runs from the core timer.
+ */
+DownloadBandwidthThrottler::DownloadBandwidthThrottler()
+{
+	m_bytesToSpend = 0;
+	m_rememberedSlotCounter = 0;
+	m_lastProcessTick = GetTickCountFullRes();
+	m_limited = false;
+}
+
+
+DownloadBandwidthThrottler::~DownloadBandwidthThrottler()
+{
+	m_StandardOrder_list.clear();
+}
+
+
+/**
+ * Relative share of the bandwidth a source gets, depending on the priority
+ * of the file it is downloading.
+ */
+uint32 DownloadBandwidthThrottler::GetPriorityWeight(uint8 priority)
+{
+	switch (priority) {
+		case PR_VERYLOW:	return 1;
+		case PR_LOW:		return 2;
+		case PR_HIGH:		return 6;
+		case PR_VERYHIGH:	return 8;
+		case PR_NORMAL:
+		default:			return 4;
+	}
+}
+
+
+/**
+ * Add a socket to the list of sockets that are downloading. Adding a socket that
+ * is already in the list only updates its priority, so this may be called on
+ * every core tick.
+ *
+ * @param socket the socket of the downloading source. If NULL, this method does nothing.
+ *
+ * @param priority the download priority of the file the source is downloading.
+ */
+void DownloadBandwidthThrottler::AddToStandardList(ThrottledReceiveSocket* socket, uint8 priority)
+{
+	if (socket) {
+		std::pair<SocketWeightMap::iterator, bool> result =
+			m_StandardOrder_list.insert(SocketWeightMap::value_type(socket, 0));
+		result.first->second = GetPriorityWeight(priority);
+
+		if (result.second && m_limited) {
+			// Newcomers wait for their share like everybody else.
+			socket->RevokeReceiveBudget();
+		}
+	}
+}
+
+
+/**
+ * Remove a socket that is no longer downloading. Whatever it didn't use of
+ * its budget goes back to the pool, and it may receive freely again.
+ *
+ * @param socket the socket that should be removed. If it isn't in the list, this method does nothing.
+ *
+ * @return true if the socket was in the list.
+ */
+bool DownloadBandwidthThrottler::RemoveFromStandardList(ThrottledReceiveSocket* socket)
+{
+	SocketWeightMap::iterator it = m_StandardOrder_list.find(socket);
+	if (it == m_StandardOrder_list.end()) {
+		return false;
+	}
+
+	m_StandardOrder_list.erase(it);
+	if (m_limited) {
+		m_bytesToSpend += socket->RevokeReceiveBudget();
+	}
+	socket->DisableReceiveLimit();
+
+	return true;
+}
+
+
+/**
+ * Forget a socket without touching it. This makes it safe to delete the socket.
+ *
+ * @param socket address to the socket that should be removed
+ */
+void DownloadBandwidthThrottler::RemoveFromAllQueues(ThrottledReceiveSocket* socket)
+{
+	m_StandardOrder_list.erase(socket);
+}
+
+
+/**
+ * Hand out the bandwidth that accumulated since the last call.
+ *
+ * Only sockets that have data waiting take part. Each of them gets a share of the
+ * available bytes proportional to its file priority. Sockets that used up their
+ * share take part in the next pass, which splits up what the others left over.
+ * Unused budgets are taken back on the next call, so the total amount read never
+ * exceeds the download limit, however the sources behave.
+ */
+void DownloadBandwidthThrottler::Process()
+{
+	const uint32 thisLoopTick = GetTickCountFullRes();
+	uint32 timeSinceLastLoop = thisLoopTick - m_lastProcessTick;
+	m_lastProcessTick = thisLoopTick;
+
+	if (thePrefs::GetMaxDownload() == UNLIMITED) {
+		if (m_limited) {
+			m_limited = false;
+
+			std::vector<ThrottledReceiveSocket*> sockets;
+			for (SocketWeightMap::iterator it = m_StandardOrder_list.begin(); it != m_StandardOrder_list.end(); ++it) {
+				sockets.push_back(it->first);
+			}
+
+			for (std::vector<ThrottledReceiveSocket*>::iterator it = sockets.begin(); it != sockets.end(); ++it) {
+				// Reading pending data may cause other sockets to be removed
+				if (m_StandardOrder_list.count(*it)) {
+					(*it)->DisableReceiveLimit();
+				}
+			}
+
+			m_bytesToSpend = 0;
+		}
+
+		return;
+	}
+
+	const uint32 allowedDataRate = thePrefs::GetMaxDownload() * 1024;
+
+	// Take back what wasn't used in the last cycle
+	for (SocketWeightMap::iterator it = m_StandardOrder_list.begin(); it != m_StandardOrder_list.end(); ++it) {
+		uint32 unused = it->first->RevokeReceiveBudget();
+		if (m_limited) {
+			m_bytesToSpend += unused;
+		}
+	}
+	m_limited = true;
+
+	if (timeSinceLastLoop > SEC2MS(2)) {
+		timeSinceLastLoop = SEC2MS(2);
+	}
+
+	m_bytesToSpend += (sint64)allowedDataRate * timeSinceLastLoop / 1000;
+
+	// Don't save up more than half a second worth of data, or an idle period
+	// would be followed by a burst above the limit.
+	if (m_bytesToSpend > allowedDataRate / 2) {
+		m_bytesToSpend = allowedDataRate / 2;
+	}
+
+	std::vector<ThrottledReceiveSocket*> hungry;
+	for (SocketWeightMap::iterator it = m_StandardOrder_list.begin(); it != m_StandardOrder_list.end(); ++it) {
+		if (it->first->IsReceivePending()) {
+			hungry.push_back(it->first);
+		}
+	}
+
+	if (!hungry.empty()) {
+		// Start with a different socket every cycle
+		m_rememberedSlotCounter %= hungry.size();
+		std::rotate(hungry.begin(), hungry.begin() + m_rememberedSlotCounter, hungry.end());
+		++m_rememberedSlotCounter;
+	}
+
+	for (uint32 round = 0; round < MAX_ROUNDS_PER_CYCLE && m_bytesToSpend > 0 && !hungry.empty(); ++round) {
+		uint64 totalWeight = 0;
+		for (std::vector<ThrottledReceiveSocket*>::iterator it = hungry.begin(); it != hungry.end(); ++it) {
+			SocketWeightMap::iterator entry = m_StandardOrder_list.find(*it);
+			if (entry != m_StandardOrder_list.end()) {
+				totalWeight += entry->second;
+			}
+		}
+
+		const sint64 bytesThisRound = m_bytesToSpend;
+		std::vector<ThrottledReceiveSocket*> stillHungry;
+
+		for (std::vector<ThrottledReceiveSocket*>::iterator it = hungry.begin(); it != hungry.end() && m_bytesToSpend > 0; ++it) {
+			// Processing the data of one socket may well disconnect another one
+			SocketWeightMap::iterator entry = m_StandardOrder_list.find(*it);
+			if (entry == m_StandardOrder_list.end()) {
+				continue;
+			}
+
+			sint64 share = bytesThisRound * entry->second / totalWeight;
+			if (share < MIN_GRANT_SIZE) {
+				share = MIN_GRANT_SIZE;
+			}
+			if (share > m_bytesToSpend) {
+				share = m_bytesToSpend;
+			}
+
+			m_bytesToSpend -= share;
+			uint32 received = (*it)->GrantReceiveBudget((uint32)share);
+
+			if (received >= share) {
+				stillHungry.push_back(*it);
+			}
+		}
+
+		hungry.swap(stillHungry);
+	}
+}
+// File_checked_for_headers
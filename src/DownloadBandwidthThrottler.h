@@ -0,0 +1,74 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2005-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+// Copyright (c) 2002-2011 Merkur ( devs@emule-project.net / http://www.emule-project.net )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef DOWNLOADBANDWIDTHTHROTTLER_H
+#define DOWNLOADBANDWIDTHTHROTTLER_H
+
+
+#include <map>
+
+#include "Types.h"
+
+class ThrottledReceiveSocket;
+
+/**
+ * Hands out receive budgets to the sockets of downloading sources.
+ *
+ * This is the receiving counterpart of UploadBandwidthThrottler. Sockets are
+ * read on the main thread, so unlike the upload throttler this class does not
+ * run its own thread, but is driven by CDownloadQueue::Process on every core
+ * tick. All methods must be called from the main thread.
+ */
+class DownloadBandwidthThrottler
+{
+public:
+	DownloadBandwidthThrottler();
+	~DownloadBandwidthThrottler();
+
+	void AddToStandardList(ThrottledReceiveSocket* socket, uint8 priority);
+	bool RemoveFromStandardList(ThrottledReceiveSocket* socket);
+	void RemoveFromAllQueues(ThrottledReceiveSocket* socket);
+
+	void Process();
+
+private:
+	static uint32 GetPriorityWeight(uint8 priority);
+
+	typedef std::map<ThrottledReceiveSocket*, uint32> SocketWeightMap;
+	// sockets of downloading sources, with the weight of the file they download
+	SocketWeightMap m_StandardOrder_list;
+
+	// Bytes to spend in current cycle. Grants are subtracted when handed out,
+	// and whatever the sockets didn't use is given back on the next cycle.
+	sint64 m_bytesToSpend;
+	// Where the next cycle starts handing out budgets, so nobody is always last.
+	uint32 m_rememberedSlotCounter;
+	uint32 m_lastProcessTick;
+	bool m_limited;
+};
+
+
+#endif
+// File_checked_for_headers
@@ -50,6 +50,7 @@
 #include "Logger.h"
 #include "GuiEvents.h"		// Needed for Notify_*
 #include "UploadQueue.h"	// Needed for CUploadQueue
+#include "DownloadBandwidthThrottler.h"	// Needed for DownloadBandwidthThrottler
 
 
 #ifdef __MULE_UNUSED_CODE__
@@ -553,7 +554,7 @@ void CUpDownClient::SetDownloadState(uint8 byNewState)
 				m_nPartCount = 0;
 			}
 			if (m_socket && byNewState != DS_ERROR) {
-				m_socket->DisableDownloadLimit();
+				theApp->downloadBandwidthThrottler->RemoveFromStandardList(m_socket);
 			}
 		}
 		m_nDownloadState = byNewState;
@@ -563,6 +564,10 @@ void CUpDownClient::SetDownloadState(uint8 byNewState)
 			}
 			SetRemoteQueueRank(0); // eMule 0.30c set like this ...
 		}
+		// Whatever is due in the new state is looked at on the next pass
+		if (m_reqfile) {
+			m_reqfile->ScheduleSourceCheck(this, ::GetTickCount());
+		}
 		UpdateDisplayedInfo(true);
 	}
 }
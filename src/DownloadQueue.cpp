@@ -46,6 +46,7 @@
 #include "PartFile.h"		// Needed for CPartFile
 #include "Preferences.h"	// Needed for thePrefs
 #include "amule.h"		// Needed for theApp
+#include "DownloadBandwidthThrottler.h"	// Needed for DownloadBandwidthThrottler
 #include "AsyncDNS.h"		// Needed for CAsyncDNS
 #include "Statistics.h"		// Needed for theStats
 #include "Logger.h"
@@ -418,16 +419,6 @@ void CDownloadQueue::Process()
 	{
 		wxMutexLocker lock(m_mutex);
 
-		uint32 downspeed = 0;
-		if (thePrefs::GetMaxDownload() != UNLIMITED && m_datarate > 1500) {
-			downspeed = (((uint32)thePrefs::GetMaxDownload())*1024*100)/(m_datarate+1);
-			if (downspeed < 50) {
-				downspeed = 50;
-			} else if (downspeed > 200) {
-				downspeed = 200;
-			}
-		}
-
 		m_datarate = 0;
 		m_udcounter++;
 		uint32 cur_datarate = 0;
@@ -446,7 +437,7 @@ void CDownloadQueue::Process()
 			mustPreventSleep |= !(status == PS_ERROR || status == PS_INSUFFICIENT || status == PS_PAUSED || status == PS_COMPLETE);
 
 			if (status == PS_READY || status == PS_EMPTY ){
-				cur_datarate += file->Process( downspeed, cur_udcounter );
+				cur_datarate += file->Process( cur_udcounter );
 			} else {
 				//This will make sure we don't keep old sources to paused and stoped files..
 				file->StopPausedFile();
@@ -457,6 +448,12 @@ void CDownloadQueue::Process()
 			}
 		}
 
+		{
+			// Hand out the download bandwidth to the sources registered above
+			CMutexUnlocker unlocker(m_mutex);
+			theApp->downloadBandwidthThrottler->Process();
+		}
+
 		if (thePrefs::GetPreventSleepWhileDownloading()) {
 			if ((mustPreventSleep == false) && (theStats::GetSessionSentBytes() < theStats::GetSessionReceivedBytes())) {
 				// I can see right through your clever plan.
@@ -1341,10 +1338,7 @@ void CDownloadQueue::AddToResolve(const CMD4Hash& fileid, const wxString& pszHos
 		if (ip) {
 			OnHostnameResolved(ip);
 		} else {
-			CAsyncDNS* dns = new CAsyncDNS(pszHostname, DNS_SOURCE, theApp);
-
-			if ((dns->Create() != wxTHREAD_NO_ERROR) || (dns->Run() != wxTHREAD_NO_ERROR)) {
-				dns->Delete();
+			if (!CAsyncDNS::Resolve(pszHostname, DNS_SOURCE, theApp)) {
 				m_toresolve.pop_front();
 			}
 		}
@@ -1390,10 +1384,7 @@ void CDownloadQueue::OnHostnameResolved(uint32 ip)
 		if (tmpIP) {
 			OnHostnameResolved(tmpIP);
 		} else {
-			CAsyncDNS* dns = new CAsyncDNS(entry.strHostname, DNS_SOURCE, theApp);
-
-			if ((dns->Create() != wxTHREAD_NO_ERROR) || (dns->Run() != wxTHREAD_NO_ERROR)) {
-				dns->Delete();
+			if (!CAsyncDNS::Resolve(entry.strHostname, DNS_SOURCE, theApp)) {
 				m_toresolve.pop_front();
 			} else {
 				break;
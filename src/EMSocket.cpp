@@ -30,9 +30,11 @@
 #include <protocol/ed2k/Constants.h>
 
 #include "Packet.h"		// Needed for CPacket
+#include "PacketBufferPool.h"	// Needed for CPacketBufferPool
 #include "amule.h"
 #include "GetTickCount.h"
 #include "UploadBandwidthThrottler.h"
+#include "DownloadBandwidthThrottler.h"
 #include "Logger.h"
 #include "Preferences.h"
 #include "ScopedPtr.h"
@@ -112,6 +114,9 @@ CEMSocket::~CEMSocket()
 	if (theApp->uploadBandwidthThrottler) {
 	    theApp->uploadBandwidthThrottler->RemoveFromAllQueues(this);
 	}
+	if (theApp->downloadBandwidthThrottler) {
+		theApp->downloadBandwidthThrottler->RemoveFromAllQueues(this);
+	}
 
     ClearQueues();
 
@@ -145,7 +150,7 @@ void CEMSocket::ClearQueues()
 	pendingHeaderSize = 0;
 
 	// Download partial packet
-	delete[] pendingPacket;
+	CPacketBufferPool::Release(pendingPacket);
 	pendingPacket = NULL;
 	pendingPacketSize = 0;
 
@@ -169,6 +174,7 @@ void CEMSocket::OnClose(int WXUNUSED(nErrorCode))
     // now that we know no other method will keep adding to the queue
     // we can remove ourself from the queue
     theApp->uploadBandwidthThrottler->RemoveFromAllQueues(this);
+	theApp->downloadBandwidthThrottler->RemoveFromAllQueues(this);
 
 	ClearQueues();
 }
@@ -201,7 +207,7 @@ void CEMSocket::OnReceive(int nErrorCode)
 		uint32 readMax;
 		byte *buf;
 		if (pendingHeaderSize < PACKET_HEADER_SIZE) {
-			delete[] pendingPacket;
+			CPacketBufferPool::Release(pendingPacket);
 			pendingPacket = NULL;
 			buf = pendingHeader + pendingHeaderSize;
 			readMax = PACKET_HEADER_SIZE - pendingHeaderSize;
@@ -213,7 +219,7 @@ void CEMSocket::OnReceive(int nErrorCode)
 				OnError(ERR_TOOBIG);
 				return;
 			}
-			pendingPacket = new byte[readMax + 1];
+			pendingPacket = CPacketBufferPool::Allocate(readMax + 1);
 			buf = pendingPacket;
 		} else {
 			buf = pendingPacket + pendingPacketSize;
@@ -306,6 +312,36 @@ void CEMSocket::DisableDownloadLimit()
 }
 
 
+/**
+ * Allows the socket to read up to the given number of bytes until the budget is
+ * revoked, and reads right away if data is waiting.
+ *
+ * @return the number of bytes that were read during this call.
+ */
+uint32 CEMSocket::GrantReceiveBudget(uint32 maxNumberOfBytesToReceive)
+{
+	SetDownloadLimit(maxNumberOfBytesToReceive);
+
+	return maxNumberOfBytesToReceive - std::min(downloadLimit, maxNumberOfBytesToReceive);
+}
+
+
+/**
+ * Stops the socket from reading until it is granted a new budget.
+ *
+ * @return the part of the previous budget that wasn't used.
+ */
+uint32 CEMSocket::RevokeReceiveBudget()
+{
+	uint32 unused = downloadLimitEnable ? downloadLimit : 0;
+
+	downloadLimit = 0;
+	downloadLimitEnable = true;
+
+	return unused;
+}
+
+
 /**
  * Queues up the packet to be sent. Another thread will actually send the packet.
  *
@@ -43,7 +43,7 @@ class CPacket;
 const uint32 PACKET_HEADER_SIZE	= 6;
 
 
-class CEMSocket : public CEncryptedStreamSocket, public ThrottledFileSocket
+class CEMSocket : public CEncryptedStreamSocket, public ThrottledFileSocket, public ThrottledReceiveSocket
 {
 public:
 	CEMSocket(const CProxyData *ProxyData = NULL);
@@ -71,6 +71,11 @@ public:
 
     uint32	GetNeededBytes();
 
+	virtual uint32	GrantReceiveBudget(uint32 maxNumberOfBytesToReceive);
+	virtual uint32	RevokeReceiveBudget();
+	virtual bool	IsReceivePending() { return pendingOnReceive; }
+	virtual void	DisableReceiveLimit() { DisableDownloadLimit(); }
+
 	//protected:
 	// these functions are public on our code because of the amuleDlg::socketHandler
 	virtual void	OnError(int WXUNUSED(nErrorCode)) { };
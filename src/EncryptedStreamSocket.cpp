@@ -190,8 +190,10 @@ int CEncryptedStreamSocket::Write(const void* lpBuf, uint32_t nBufLen)
 	} else if (m_bServerCrypt && m_StreamCryptState == ECS_ENCRYPTING && !m_pfiSendBuffer.IsEmpty()) {
 		wxASSERT( m_NegotiatingState == ONS_BASIC_SERVER_DELAYEDSENDING );
 		// handshakedata was delayed to put it into one frame with the first paypload to the server
-		// do so now with the payload attached
-		int nRes = SendNegotiatingData(lpBuf, nBufLen, nBufLen);
+		// do so now with the payload attached. The payload is already encrypted.
+		m_pfiSendBuffer.Append((const uint8*)lpBuf, nBufLen);
+		m_NegotiatingState = ONS_COMPLETE;
+		int nRes = SendNegotiatingData(NULL, 0);
 		wxASSERT( nRes != SOCKET_ERROR );
 		(void)nRes;
 		return nBufLen;	// report a full send, even if we didn't for some reason - the data is now in our buffer and will be handled later
@@ -678,28 +680,19 @@ int CEncryptedStreamSocket::Negotiate(const uint8* pBuffer, uint32 nLen)
 	}
 }
 
-int CEncryptedStreamSocket::SendNegotiatingData(const void* lpBuf, uint32_t nBufLen, uint32_t nStartCryptFromByte, bool bDelaySend)
+int CEncryptedStreamSocket::SendNegotiatingData(void* lpBuf, uint32_t nBufLen, uint32_t nStartCryptFromByte, bool bDelaySend)
 {
 	wxASSERT( m_StreamCryptState == ECS_NEGOTIATING || m_StreamCryptState == ECS_ENCRYPTING );
 	wxASSERT( nStartCryptFromByte <= nBufLen );
 	wxASSERT( m_NegotiatingState == ONS_BASIC_SERVER_DELAYEDSENDING || !bDelaySend );
 	//printf("Send negotiation data on %s\n", (const char*) unicode2char(GetPeer()));
-	uint8_t* pBuffer = NULL;
-	bool bProcess = false;
-	if (lpBuf != NULL) {
-		pBuffer = new uint8_t[nBufLen];
-		if (pBuffer == NULL) {
-			throw CMuleException(wxT("Memory exception"), wxT("Memory exception on TCP encrypted socket"));
-		}
-
-		if (nStartCryptFromByte > 0) {
-			memcpy(pBuffer, lpBuf, nStartCryptFromByte);
-		}
-
+	uint8_t* pBuffer = (uint8_t*)lpBuf;
+	if (pBuffer != NULL) {
 		if (nBufLen - nStartCryptFromByte > 0) {
+			// The buffer is scratch space of the caller, so encrypt it in place
 			//printf("Crypting negotiation data on %s starting on byte %i\n", (const char*) unicode2char(GetPeer()), nStartCryptFromByte);
-			//DumpMem(lpBuf, nBufLen, wxT("Pre-encryption:"));
-			m_pfiSendBuffer.RC4Crypt((uint8*)lpBuf + nStartCryptFromByte, pBuffer + nStartCryptFromByte, nBufLen - nStartCryptFromByte);
+			//DumpMem(pBuffer, nBufLen, wxT("Pre-encryption:"));
+			m_pfiSendBuffer.RC4Crypt(pBuffer + nStartCryptFromByte, pBuffer + nStartCryptFromByte, nBufLen - nStartCryptFromByte);
 			//DumpMem(pBuffer, nBufLen, wxT("Post-encryption:"));
 		}
 
@@ -711,45 +704,48 @@ int CEncryptedStreamSocket::SendNegotiatingData(const void* lpBuf, uint32_t nBuf
 				wxFAIL;
 			}
 			m_pfiSendBuffer.Append(pBuffer, nBufLen);
-			delete[] pBuffer;
-			pBuffer = NULL;
-			nStartCryptFromByte = 0;
-			bProcess = true; // we want to try to send it right now
+			pBuffer = NULL; // we want to try to send it right now
 		}
 	}
 
-	if (lpBuf == NULL || bProcess) {
-		// this call is for processing pending data
-		if (m_pfiSendBuffer.IsEmpty() || nStartCryptFromByte != 0) {
+	if (bDelaySend) {
+		if (pBuffer != NULL) {
+			m_pfiSendBuffer.Write(pBuffer, nBufLen);
+		}
+		return 0;
+	}
+
+	if (pBuffer == NULL) {
+		// this call is for processing pending data, send it right from our buffer
+		if (m_pfiSendBuffer.IsEmpty()) {
 			wxFAIL;
 			return 0;							// or not
 		}
 		nBufLen = (uint32)m_pfiSendBuffer.GetLength();
-		pBuffer = m_pfiSendBuffer.Detach();
+		//printf("Writing pending negotiation data on %s: ", (const char*) unicode2char(GetPeer()));
+		uint32_t result = CSocketClientProxy::Write(m_pfiSendBuffer.GetRawBuffer(), nBufLen);
+		//printf("Wrote %i bytes\n",result);
+		if (result != (uint32_t)SOCKET_ERROR) {
+			// Keep what couldn't be sent
+			m_pfiSendBuffer.DiscardFront(result);
+		}
+		return result;
 	}
 
 	wxASSERT( m_pfiSendBuffer.IsEmpty() );
 
-	uint32_t result = 0;
-	if (!bDelaySend) {
-		//printf("Writing negotiation data on %s: ", (const char*) unicode2char(GetPeer()));
-		result = CSocketClientProxy::Write(pBuffer, nBufLen);
-		//printf("Wrote %i bytes\n",result);
-	}
+	//printf("Writing negotiation data on %s: ", (const char*) unicode2char(GetPeer()));
+	uint32_t result = CSocketClientProxy::Write(pBuffer, nBufLen);
+	//printf("Wrote %i bytes\n",result);
 
-	if (result == (uint32_t)SOCKET_ERROR || bDelaySend) {
+	if (result == (uint32_t)SOCKET_ERROR) {
 		m_pfiSendBuffer.Write(pBuffer, nBufLen);
-		delete[] pBuffer;
-		return result;
-	} else {
-		if (result < nBufLen) {
-			// Store the partial data pending
-			//printf("Partial negotiation pending on %s\n", (const char*) unicode2char(GetPeer()));
-			m_pfiSendBuffer.Write(pBuffer + result, nBufLen - result);
-		}
-		delete[] pBuffer;
-		return result;
+	} else if (result < nBufLen) {
+		// Store the partial data pending
+		//printf("Partial negotiation pending on %s\n", (const char*) unicode2char(GetPeer()));
+		m_pfiSendBuffer.Write(pBuffer + result, nBufLen - result);
 	}
+	return result;
 }
 
 
@@ -123,7 +123,7 @@ protected:
 private:
 	int	Negotiate(const uint8_t* pBuffer, uint32_t nLen);
 	void	StartNegotiation(bool bOutgoing);
-	int	SendNegotiatingData(const void *lpBuf, uint32_t nBufLen, uint32_t nStartCryptFromByte = 0, bool bDelaySend = false);
+	int	SendNegotiatingData(void *lpBuf, uint32_t nBufLen, uint32_t nStartCryptFromByte = 0, bool bDelaySend = false);
 
 	ENegotiatingState	m_NegotiatingState;
 	CRC4EncryptableBuffer	m_pfiReceiveBuffer;
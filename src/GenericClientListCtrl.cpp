@@ -837,7 +837,7 @@ void CGenericClientListCtrl::DrawClientItem(wxDC* dc, int nColumn, const wxRect&
 #ifdef ENABLE_IP2COUNTRY
 				if (theApp->amuledlg->m_IP2Country->IsEnabled() && thePrefs::IsGeoIPEnabled()) {
 					// Draw the flag. Size can't be precached.
-					const CountryData& countrydata = theApp->amuledlg->m_IP2Country->GetCountryData(client.GetFullIP());
+					const CountryData& countrydata = theApp->amuledlg->m_IP2Country->GetCountryData(client.GetFullUserIP());
 
 					realY = point.y + (rect.GetHeight() - countrydata.Flag.GetHeight())/2 + 1 /* floor() */;
 
@@ -43,6 +43,25 @@ uint32 GetTickCountFullRes() {
 	return GetTickCount_64();
 }
 
+/**
+ * Returns the highres timer in microseconds.
+ */
+uint64 GetTickCountMicro()
+{
+	static double tickFactor;
+	_LARGE_INTEGER li;
+
+	static bool first = true;
+	if (first) {
+		QueryPerformanceFrequency(&li);
+		tickFactor = 1000000.0 / li.QuadPart;
+		first = false;
+	}
+
+	QueryPerformanceCounter(&li);
+	return li.QuadPart * tickFactor;
+}
+
 /**
  * Returns the tickcount in 64bits.
  */
@@ -81,6 +100,12 @@ uint32 GetTickCountFullRes(void) {
 	return msecs;
 }
 
+uint64 GetTickCountMicro() {
+	struct timeval aika;
+	gettimeofday(&aika,NULL);
+	return aika.tv_sec * (uint64)1000000 + aika.tv_usec;
+}
+
 #if wxUSE_GUI && wxUSE_TIMER && !defined(AMULE_DAEMON)
 /**
  * Copyright (c) 2003-2011 Alo Sarv ( madcat_@users.sourceforge.net )
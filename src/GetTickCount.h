@@ -44,6 +44,11 @@
 
 uint32 GetTickCountFullRes();
 
+// Microseconds, for timing short operations. On Unix this follows the wall
+// clock, so it can go backwards when the clock is set.
+
+uint64 GetTickCountMicro();
+
 uint64 GetTickCount64();
 
 // Functions used to init the timer on GUI
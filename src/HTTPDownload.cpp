@@ -141,7 +141,7 @@ DEFINE_LOCAL_EVENT_TYPE(wxEVT_HTTP_SHUTDOWN)
 
 
 CHTTPDownloadThread::CHTTPDownloadThread(const wxString& url, const wxString& filename, const wxString& oldfilename, HTTP_Download_File file_id,
-										bool showDialog, bool checkDownloadNewer)
+										bool showDialog, bool checkDownloadNewer, CHTTPDownloadHandler* handler)
 #ifdef AMULE_DAEMON
 	: CMuleThread(wxTHREAD_DETACHED),
 #else
@@ -151,7 +151,8 @@ CHTTPDownloadThread::CHTTPDownloadThread(const wxString& url, const wxString& fi
 	  m_tempfile(filename),
 	  m_result(-1),
 	  m_file_id(file_id),
-	  m_companion(NULL)
+	  m_companion(NULL),
+	  m_handler(handler)
 {
 	if (showDialog) {
 #ifndef AMULE_DAEMON
@@ -174,6 +175,12 @@ CHTTPDownloadThread::CHTTPDownloadThread(const wxString& url, const wxString& fi
 }
 
 
+CHTTPDownloadThread::~CHTTPDownloadThread()
+{
+	delete m_handler;
+}
+
+
 // Format the given date to a RFC-2616 compliant HTTP date
 // Example: Thu, 14 Jan 2010 15:40:23 GMT
 wxString CHTTPDownloadThread::FormatDateHTTP(const wxDateTime& date)
@@ -199,10 +206,13 @@ CMuleThread::ExitCode CHTTPDownloadThread::Entry()
 	bool use_proxy = proxy_data != NULL && proxy_data->m_proxyEnable;
 
 	try {
-		wxFFileOutputStream outfile(m_tempfile);
+		CScopedPtr<wxFFileOutputStream> outfile;
+		if (!m_handler) {
+			outfile.reset(new wxFFileOutputStream(m_tempfile));
 
-		if (!outfile.Ok()) {
-			throw wxString(CFormat(_("Unable to create destination file %s for download!")) % m_tempfile);
+			if (!outfile->Ok()) {
+				throw wxString(CFormat(_("Unable to create destination file %s for download!")) % m_tempfile);
+			}
 		}
 
 		if (m_url.IsEmpty()) {
@@ -256,11 +266,19 @@ CMuleThread::ExitCode CHTTPDownloadThread::Entry()
 			current_read = url_read_stream->LastRead();
 			if (current_read) {
 				total_read += current_read;
-				outfile.Write(buffer,current_read);
-				int current_write = outfile.LastWrite();
-				if (current_read != current_write) {
-					throw wxString(_("Critical error while writing downloaded file"));
-				} else if (m_companion) {
+				if (m_handler) {
+					if (!m_handler->OnData(buffer, current_read)) {
+						m_result = HTTP_Error;
+						throw wxString(_("Critical error while processing downloaded file"));
+					}
+				} else {
+					outfile->Write(buffer,current_read);
+					int current_write = outfile->LastWrite();
+					if (current_read != current_write) {
+						throw wxString(_("Critical error while writing downloaded file"));
+					}
+				}
+				if (m_companion) {
 #ifndef AMULE_DAEMON
 					CMuleInternalEvent evt(wxEVT_HTTP_PROGRESS);
 					evt.SetInt(total_read);
@@ -285,7 +303,7 @@ CMuleThread::ExitCode CHTTPDownloadThread::Entry()
 			}
 		}
 	} catch (const wxString& error) {
-		if (wxFileExists(m_tempfile)) {
+		if (!m_handler && wxFileExists(m_tempfile)) {
 			wxRemoveFile(m_tempfile);
 		}
 		if (!error.IsEmpty()) {
@@ -293,6 +311,10 @@ CMuleThread::ExitCode CHTTPDownloadThread::Entry()
 		}
 	}
 
+	if (m_handler && !m_handler->OnFinished(m_result == HTTP_Success) && m_result == HTTP_Success) {
+		m_result = HTTP_Error;
+	}
+
 	if (m_result == HTTP_Success) {
 		thePrefs::SetLastHTTPDownloadURL(m_file_id, m_url);
 	}
@@ -42,12 +42,43 @@ enum HTTPDownloadResult {
 	HTTP_Skipped
 };
 
+
+/**
+ * Receives the data of a download while it arrives.
+ *
+ * A download with a handler doesn't write its destination file, the
+ * handler decides what to do with the data. Both functions are called
+ * from the download thread.
+ */
+class CHTTPDownloadHandler
+{
+public:
+	virtual ~CHTTPDownloadHandler() {}
+
+	/**
+	 * Called for every block of data received.
+	 *
+	 * @return False to abort the download.
+	 */
+	virtual bool OnData(const char* data, uint32 length) = 0;
+
+	/**
+	 * Called once when the download is over, whatever its outcome.
+	 *
+	 * @param success True if all data was received.
+	 * @return False if the handler failed to process the data.
+	 */
+	virtual bool OnFinished(bool success) = 0;
+};
+
+
 class CHTTPDownloadThread : public CMuleThread
 {
 public:
 	/** Note: wxChar* is used to circumvent the thread-unsafe wxString reference counting. */
 	CHTTPDownloadThread(const wxString& url, const wxString& filename, const wxString& oldfilename, HTTP_Download_File file_id,
-						bool showDialog, bool checkDownloadNewer);
+						bool showDialog, bool checkDownloadNewer, CHTTPDownloadHandler* handler = NULL);
+	~CHTTPDownloadThread();
 
 	static void StopAll();
 private:
@@ -62,6 +93,7 @@ private:
 	int			m_error;	//! Additional error code (@see wxProtocol class)
 	HTTP_Download_File	m_file_id;
 	wxEvtHandler*		m_companion;
+	CHTTPDownloadHandler*	m_handler;	//! Gets the data instead of m_tempfile, owned by the thread.
 	typedef std::set<CHTTPDownloadThread *>	ThreadSet;
 	static ThreadSet	s_allThreads;
 	static wxMutex		s_allThreadsMutex;
@@ -61,6 +61,7 @@
 #include "CFile.h"			// For CPath
 #include "HTTPDownload.h"
 #include "Logger.h"			// For AddLogLineM()
+#include "NetworkFunctions.h"		// For StringIPtoUint32()
 #include <common/Format.h>		// For CFormat()
 #include "common/FileFunctions.h"	// For UnpackArchive
 #include <common/StringFunctions.h>	// For unicode2char()
@@ -72,6 +73,11 @@
 #include <GeoIP.h>
 #include "IP2Country.h"
 
+// Number of entries in the lookup cache, must be a power of 2
+static const uint32 CACHE_SIZE = 4096;
+// Marks an unused cache entry
+static const uint16 NO_COUNTRY = 0xFFFF;
+
 CIP2Country::CIP2Country(const wxString& configDir)
 {
 	m_geoip = NULL;
@@ -93,6 +99,9 @@ void CIP2Country::Enable()
 	}
 
 	m_geoip = GeoIP_open(unicode2char(m_DataBasePath), GEOIP_STANDARD);
+	if (m_geoip) {
+		BuildCountryTable();
+	}
 }
 
 void CIP2Country::Update()
@@ -109,6 +118,8 @@ void CIP2Country::Disable()
 		GeoIP_delete(m_geoip);
 		m_geoip = NULL;
 	}
+	m_countries.clear();
+	m_cache.clear();
 }
 
 void CIP2Country::DownloadFinished(uint32 result)
@@ -176,6 +187,46 @@ void CIP2Country::LoadFlags()
 	}
 
 	AddDebugLogLineN(logGeneral, CFormat(wxT("Loaded %d flag bitmaps.")) % m_CountryDataMap.size());  // there's never just one - no plural needed
+
+	CountryDataMap::iterator it = m_CountryDataMap.find(wxString(wxT("unknown")));
+	if (it != m_CountryDataMap.end()) {
+		m_unknown.Flag = it->second.Flag;
+	}
+	m_unknown.Name = wxT("?");
+}
+
+
+void CIP2Country::BuildCountryTable()
+{
+	m_countries.clear();
+	// Id 0 is used for addresses GeoIP doesn't know
+	m_countries.push_back(m_unknown);
+
+	const char * c;
+	for (int id = 1; (c = GeoIP_code_by_id(id)) != NULL; ++id) {
+		// wxString::MakeLower() fails miserably in Turkish localization with their dotted/non-dotted 'i's
+		// So fall back to some good ole C string processing.
+		std::string strCode;
+		for ( ; *c; c++) {
+			strCode += ((*c >= 'A' && *c <= 'Z') ? *c + 'a' - 'A' : *c);
+		}
+
+		const wxString CCode(strCode.c_str(), wxConvISO8859_1);
+
+		CountryDataMap::iterator it = m_CountryDataMap.find(CCode);
+		if (it != m_CountryDataMap.end()) {
+			m_countries.push_back(it->second);
+		} else {
+			// Show the code and ?? flag
+			CountryData countrydata;
+			countrydata.Name = CCode;
+			countrydata.Flag = m_unknown.Flag;
+			m_countries.push_back(countrydata);
+		}
+	}
+
+	CacheEntry unused = { 0, NO_COUNTRY };
+	m_cache.assign(CACHE_SIZE, unused);
 }
 
 
@@ -187,39 +238,34 @@ CIP2Country::~CIP2Country()
 
 const CountryData& CIP2Country::GetCountryData(const wxString &ip)
 {
-	// Should prevent the crash if the GeoIP database does not exists
-	if (m_geoip == NULL) {
-		CountryDataMap::iterator it = m_CountryDataMap.find(wxString(wxT("unknown")));
-		it->second.Name = wxT("?");
-		return it->second;
+	uint32 ipNum;
+	if (!StringIPtoUint32(ip, ipNum)) {
+		return m_unknown;
 	}
 
-	// wxString::MakeLower() fails miserably in Turkish localization with their dotted/non-dotted 'i's
-	// So fall back to some good ole C string processing.
-	std::string strCode;
-	const char * c = GeoIP_country_code_by_addr(m_geoip, unicode2char(ip));
-	if (!c) {
-		c = "unknown";
-	}
-	for ( ; *c; c++) {
-		strCode += ((*c >= 'A' && *c <= 'Z') ? *c + 'a' - 'A' : *c);
+	return GetCountryData(ipNum);
+}
+
+
+const CountryData& CIP2Country::GetCountryData(uint32 ip)
+{
+	// Should prevent the crash if the GeoIP database does not exists
+	if (m_geoip == NULL || m_cache.empty()) {
+		return m_unknown;
 	}
 
-	const wxString CCode(strCode.c_str(), wxConvISO8859_1);
-
-	CountryDataMap::iterator it = m_CountryDataMap.find(CCode);
-	if (it == m_CountryDataMap.end()) {
-		// Show the code and ?? flag
-		it = m_CountryDataMap.find(wxString(wxT("unknown")));
-		wxASSERT(it != m_CountryDataMap.end());
-		if (CCode.IsEmpty()) {
-			it->second.Name = wxT("?");
-		} else{
-			it->second.Name = CCode;
+	CacheEntry& entry = m_cache[((ip * 2654435761u) >> 20) & (CACHE_SIZE - 1)];
+	if (entry.ip != ip || entry.country == NO_COUNTRY) {
+		// GeoIP wants the first byte of the address in the highest bits
+		int id = GeoIP_id_by_ipnum(m_geoip, wxUINT32_SWAP_ALWAYS(ip));
+		if (id < 0 || id >= (int)m_countries.size()) {
+			id = 0;
 		}
+		entry.ip = ip;
+		entry.country = id;
 	}
 
-	return it->second;
+	return m_countries[entry.country];
 }
 
 #else
@@ -241,4 +287,10 @@ const CountryData& CIP2Country::GetCountryData(const wxString &)
 	return dummy;
 }
 
+const CountryData& CIP2Country::GetCountryData(uint32)
+{
+	static CountryData dummy;
+	return dummy;
+}
+
 #endif // ENABLE_IP2COUNTRY
@@ -46,6 +46,7 @@
 #include "Types.h"	// Needed for uint8, uint16 and uint32
 
 #include <map>
+#include <vector>
 
 #include <wx/image.h>
 #include <wx/string.h>
@@ -65,6 +66,12 @@ public:
 	CIP2Country(const wxString& configDir);
 	~CIP2Country();
 	const CountryData& GetCountryData(const wxString& ip);
+	/**
+	 * Returns the country of an IP in the usual byte order (see
+	 * Uint32toStringIP). Recently seen IPs are answered from a cache,
+	 * so this is cheap enough to call for every row of a list.
+	 */
+	const CountryData& GetCountryData(uint32 ip);
 	void Enable();
 	void Disable();
 	void Update();
@@ -77,7 +84,20 @@ private:
 	wxString m_DataBaseName;
 	wxString m_DataBasePath;
 
+	//! Country data by GeoIP country id, built when the database is opened
+	std::vector<CountryData> m_countries;
+	//! Returned if the country can't be determined
+	CountryData m_unknown;
+
+	struct CacheEntry {
+		uint32 ip;
+		uint16 country;
+	};
+	//! Direct-mapped cache of recently looked up IPs
+	std::vector<CacheEntry> m_cache;
+
 	void LoadFlags();
+	void BuildCountryTable();
 };
 
 #endif // IP2COUNTRY_H
@@ -44,6 +44,83 @@
 #include "RangeMap.h"			// Needed for CRangeMap
 #include "ServerConnect.h"		// Needed for ConnectToAnyServer()
 #include "DownloadQueue.h"		// Needed for theApp->downloadqueue
+#include "OtherFunctions.h"		// Needed for DeleteContents
+
+#include <zlib.h>			// Needed for crc32
+
+
+#ifdef _MSC_VER
+#include <windows.h>			// Needed for Interlocked*
+#endif
+
+
+////////////////////////////////////////////////////////////
+// Atomic helpers
+//
+// Lookups don't lock. They announce themselves in a reader count and then
+// read the table pointer, while a reload publishes the new table and then
+// checks the reader count. Everything uses sequentially consistent
+// operations, so a reader that was not counted when the old table was
+// retired is guaranteed to see the new table.
+
+#if defined(__ATOMIC_SEQ_CST)
+
+template<typename T> static inline T* AtomicLoadPtr(T* volatile* ptr)
+{
+	return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);
+}
+
+template<typename T> static inline T* AtomicExchangePtr(T* volatile* ptr, T* value)
+{
+	return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);
+}
+
+static inline long AtomicAdd(volatile long* count, long value)
+{
+	return __atomic_add_fetch(count, value, __ATOMIC_SEQ_CST);
+}
+
+#elif defined(__GNUC__)
+
+template<typename T> static inline T* AtomicLoadPtr(T* volatile* ptr)
+{
+	return __sync_fetch_and_add(ptr, 0);
+}
+
+template<typename T> static inline T* AtomicExchangePtr(T* volatile* ptr, T* value)
+{
+	T* old;
+	do {
+		old = *ptr;
+	} while (!__sync_bool_compare_and_swap(ptr, old, value));
+	return old;
+}
+
+static inline long AtomicAdd(volatile long* count, long value)
+{
+	return __sync_add_and_fetch(count, value);
+}
+
+#elif defined(_MSC_VER)
+
+template<typename T> static inline T* AtomicLoadPtr(T* volatile* ptr)
+{
+	return static_cast<T*>(InterlockedCompareExchangePointer(reinterpret_cast<PVOID volatile*>(ptr), NULL, NULL));
+}
+
+template<typename T> static inline T* AtomicExchangePtr(T* volatile* ptr, T* value)
+{
+	return static_cast<T*>(InterlockedExchangePointer(reinterpret_cast<PVOID volatile*>(ptr), value));
+}
+
+static inline long AtomicAdd(volatile long* count, long value)
+{
+	return InterlockedExchangeAdd(count, value) + value;
+}
+
+#else
+#	error "No atomic operations available for this compiler."
+#endif
 
 
 ////////////////////////////////////////////////////////////
@@ -92,6 +169,10 @@ typedef void (wxEvtHandler::*MuleIPFilterEventFunction)(CIPFilterEvent&);
 ////////////////////////////////////////////////////////////
 // Thread task for loading the ipfilter.dat files.
 
+// The scanner keeps its state in globals, so only one
+// thread at a time may use it.
+static wxMutex s_scannerMutex;
+
 /**
  * This task loads the two ipfilter.dat files, a task that
  * can take quite a while on a slow system with a large dat-
@@ -99,31 +180,51 @@ typedef void (wxEvtHandler::*MuleIPFilterEventFunction)(CIPFilterEvent&);
  */
 class CIPFilterTask : public CThreadTask
 {
+	friend class CIPFilterUpdater;
 public:
-	CIPFilterTask(wxEvtHandler* owner)
-		: CThreadTask(wxT("Load IPFilter"), wxEmptyString, ETP_Critical),
+	/**
+	 * @param owner Receives the generated filter.
+	 * @param downloaded If true, the ranges of ipfilter.dat are added with
+	 *                   AddDownloadedLines() before the task is scheduled.
+	 */
+	CIPFilterTask(wxEvtHandler* owner, bool downloaded = false)
+		: CThreadTask(wxT("Load IPFilter"), downloaded ? wxT("downloaded") : wxEmptyString, ETP_Critical),
 		  m_storeDescriptions(false),
+		  m_downloaded(downloaded),
+		  m_downloadedRanges(0),
+		  m_downloadedBad(0),
+		  m_downloadedLine(1),
 		  m_owner(owner)
 	{
+#ifdef __DEBUG__
+		m_storeDescriptions = theLogger.IsEnabled(logIPFilter);
+#endif
 	}
 
 private:
 	void Entry()
 	{
-		AddLogLineN(_("Loading IP filters 'ipfilter.dat' and 'ipfilter_static.dat'."));
-		if ( !LoadFromFile(thePrefs::GetConfigDir() + wxT("ipfilter.dat")) &&
-		     thePrefs::UseIPFilterSystem() ) {
-			// Load from system wide IP filter file
-			wxStandardPathsBase &spb(wxStandardPaths::Get());
-#ifdef __WINDOWS__
-			wxString dataDir(spb.GetPluginsDir());
-#elif defined(__WXMAC__)
-			wxString dataDir(spb.GetDataDir());
-#else
-			wxString dataDir(spb.GetDataDir().BeforeLast(wxT('/')) + wxT("/amule"));
+		// Descriptions are only needed for debugging, and aren't cached
+		bool useCache = true;
+#ifdef __DEBUG__
+		useCache = !theLogger.IsEnabled(logIPFilter);
 #endif
-			wxString systemwideFile(JoinPaths(dataDir,wxT("ipfilter.dat")));
-			LoadFromFile(systemwideFile);
+		if (m_downloaded) {
+			// ipfilter.dat was parsed while it was downloaded
+			AddLogLineN(_("Loading IP filter 'ipfilter_static.dat'."));
+		} else {
+			if (useCache && LoadCache()) {
+				CIPFilterEvent evt(m_rangeIPs, m_rangeLengths, m_rangeNames);
+				wxPostEvent(m_owner, evt);
+				return;
+			}
+
+			AddLogLineN(_("Loading IP filters 'ipfilter.dat' and 'ipfilter_static.dat'."));
+			if ( !LoadFromFile(thePrefs::GetConfigDir() + wxT("ipfilter.dat")) &&
+			     thePrefs::UseIPFilterSystem() ) {
+				// Load from system wide IP filter file
+				LoadFromFile(GetSystemwideFile());
+			}
 		}
 
 
@@ -141,54 +242,22 @@ private:
 		}
 		for (IPMap::iterator it = m_result.begin(); it != m_result.end(); ++it) {
 			if (it->AccessLevel < accessLevel) {
-				// Calculate range "length"
-				// (which is included-end - start and thus length - 1)
-				// Encoding:
-				// 0      - 0x7fff	same
-				// 0x8000 - 0xffff	0xfff	- 0x07ffffff
-				// that means: remove msb, shift left by 12 bit, add 0xfff
-				// so it can cover 8 consecutive class A nets
-				// larger ranges (or theoretical ranges with uneven ends) have to be split
-				uint32 startIP = it.keyStart();
-				uint32 realLength = it.keyEnd() - it.keyStart() + 1;
+				uint32 parts = CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, it.keyStart(), it.keyEnd());
 #ifdef __DEBUG__
-				std::string * descp = 0;
-#endif
-				while (realLength) {
-					m_rangeIPs.push_back(startIP);
-					uint32 curLength = realLength;
-					uint16 pushLength;
-					if (realLength <= 0x8000) {
-						pushLength = realLength - 1;
-					} else {
-						if (curLength >= 0x08000000) {
-							// range to big, limit
-							curLength = 0x08000000;
-						} else {
-							// cut off LSBs
-							curLength &= 0x07FFF000;
-						}
-						pushLength = ((curLength - 1) >> 12) | 0x8000;
-					}
-					m_rangeLengths.push_back(pushLength);
-#ifdef __DEBUG__
-					if (m_storeDescriptions) {
-						// std::string has no ref counting, so swap it
-						// (it's used so we need half the space than wxString with wide chars)
-						if (descp) {
-							// we split the range so we have to duplicate it
-							m_rangeNames.push_back(*descp);
-						} else {
-							// push back empty string and swap
-							m_rangeNames.push_back(std::string());
-							descp = & * m_rangeNames.rbegin();
-							std::swap(*descp, it->Description);
-						}
+				if (m_storeDescriptions) {
+					// std::string has no ref counting, so swap it
+					// (it's used so we need half the space than wxString with wide chars)
+					m_rangeNames.push_back(std::string());
+					std::swap(*m_rangeNames.rbegin(), it->Description);
+					// if we split the range we have to duplicate it
+					const std::string desc = *m_rangeNames.rbegin();
+					for (uint32 i = 1; i < parts; ++i) {
+						m_rangeNames.push_back(desc);
 					}
-#endif
-					realLength -= curLength;
-					startIP += curLength;
 				}
+#else
+				(void)parts;
+#endif
 			}
 		}
 		// Numbers are probably different:
@@ -196,10 +265,186 @@ private:
 		// - some ranges from the map have to be split for the table
 		AddDebugLogLineN(logIPFilter, CFormat(wxT("Ranges in map: %d  blocked ranges in table: %d")) % size % m_rangeIPs.size());
 
+		if (useCache && !TestDestroy()) {
+			SaveCache();
+		}
+
 		CIPFilterEvent evt(m_rangeIPs, m_rangeLengths, m_rangeNames);
 		wxPostEvent(m_owner, evt);
 	}
 
+	/**
+	 * Returns the system wide ipfilter.dat, used if the user has none.
+	 */
+	static wxString GetSystemwideFile()
+	{
+		wxStandardPathsBase &spb(wxStandardPaths::Get());
+#ifdef __WINDOWS__
+		wxString dataDir(spb.GetPluginsDir());
+#elif defined(__WXMAC__)
+		wxString dataDir(spb.GetDataDir());
+#else
+		wxString dataDir(spb.GetDataDir().BeforeLast(wxT('/')) + wxT("/amule"));
+#endif
+		return JoinPaths(dataDir,wxT("ipfilter.dat"));
+	}
+
+	/**
+	 * Describes everything the filter table is generated from: the
+	 * size and modification time of all files that may be loaded, and
+	 * the filter level. If any of it changes, the cache is outdated.
+	 */
+	static wxString GetCacheKey()
+	{
+		wxString key = CFormat(wxT("level=%u")) % (uint32)thePrefs::GetIPFilterLevel();
+
+		std::vector<wxString> files;
+		files.push_back(thePrefs::GetConfigDir() + wxT("ipfilter.dat"));
+		if (thePrefs::UseIPFilterSystem()) {
+			files.push_back(GetSystemwideFile());
+		}
+		files.push_back(thePrefs::GetConfigDir() + wxT("ipfilter_static.dat"));
+
+		for (std::vector<wxString>::iterator it = files.begin(); it != files.end(); ++it) {
+			const CPath path(*it);
+			sint64 size = 0;
+			sint64 mtime = 0;
+			if (path.FileExists()) {
+				size = path.GetFileSize();
+				mtime = CPath::GetModificationTime(path);
+			}
+			key << CFormat(wxT("\n%s %i %i")) % *it % size % mtime;
+		}
+
+		return key;
+	}
+
+	/**
+	 * Header of the cache file. The file is only used on the machine that
+	 * wrote it, so everything is stored in native byte order. The magic
+	 * number also detects a file written with another byte order.
+	 */
+	struct CacheHeader
+	{
+		uint32	magic;
+		uint32	version;
+		//! Length of the key that follows the header, in bytes
+		uint32	keyLength;
+		//! Number of ranges following the key
+		uint32	rangeCount;
+		//! CRC32 of the key and the ranges
+		uint32	checksum;
+	};
+
+	static const uint32 CACHE_MAGIC = 0x43464961;	// "aIFC"
+	static const uint32 CACHE_VERSION = 1;
+
+	static wxString GetCacheFile()
+	{
+		return thePrefs::GetConfigDir() + wxT("ipfilter.cache");
+	}
+
+	/**
+	 * Loads the ranges generated on a previous run, if the sources
+	 * haven't changed since.
+	 *
+	 * @return True if the ranges were loaded from the cache.
+	 */
+	bool LoadCache()
+	{
+		wxFFile file;
+		if (!wxFileExists(GetCacheFile()) || !file.Open(GetCacheFile(), wxT("rb"))) {
+			return false;
+		}
+
+		CacheHeader header;
+		if (file.Read(&header, sizeof(header)) != sizeof(header)
+			|| header.magic != CACHE_MAGIC || header.version != CACHE_VERSION
+			|| header.keyLength > 0x100000 || header.rangeCount > 0x10000000) {
+			AddDebugLogLineN(logIPFilter, wxT("IP filter cache has an unknown format"));
+			return false;
+		}
+
+		Unicode2CharBuf key(unicode2UTF8(GetCacheKey()));
+		const uint32 keyLength = strlen(key);
+		if (header.keyLength != keyLength) {
+			return false;
+		}
+		std::vector<char> storedKey(keyLength + 1);
+		if (file.Read(&storedKey[0], keyLength) != keyLength || memcmp(&storedKey[0], key, keyLength) != 0) {
+			AddDebugLogLineN(logIPFilter, wxT("IP filter cache is outdated"));
+			return false;
+		}
+
+		CIPFilter::RangeIPs rangeIPs(header.rangeCount);
+		CIPFilter::RangeLengths rangeLengths(header.rangeCount);
+		if (header.rangeCount) {
+			if (file.Read(&rangeIPs[0], header.rangeCount * sizeof(uint32)) != header.rangeCount * sizeof(uint32)
+				|| file.Read(&rangeLengths[0], header.rangeCount * sizeof(uint16)) != header.rangeCount * sizeof(uint16)) {
+				AddDebugLogLineN(logIPFilter, wxT("IP filter cache is truncated"));
+				return false;
+			}
+		}
+
+		uLong checksum = crc32(0, (const Bytef*)(const char*)key, keyLength);
+		if (header.rangeCount) {
+			checksum = crc32(checksum, (const Bytef*)&rangeIPs[0], header.rangeCount * sizeof(uint32));
+			checksum = crc32(checksum, (const Bytef*)&rangeLengths[0], header.rangeCount * sizeof(uint16));
+		}
+		if (checksum != header.checksum) {
+			AddLogLineC(_("IP filter cache is corrupted, loading the filter files."));
+			return false;
+		}
+
+		std::swap(m_rangeIPs, rangeIPs);
+		std::swap(m_rangeLengths, rangeLengths);
+		AddLogLineN(CFormat(wxPLURAL("Loaded %u IP-range from the IP filter cache.", "Loaded %u IP-ranges from the IP filter cache.", header.rangeCount)) % header.rangeCount);
+
+		return true;
+	}
+
+	/**
+	 * Stores the generated ranges, so the next run can skip parsing the
+	 * filter files. Failing to do so is harmless.
+	 */
+	void SaveCache()
+	{
+		Unicode2CharBuf key(unicode2UTF8(GetCacheKey()));
+
+		CacheHeader header;
+		header.magic = CACHE_MAGIC;
+		header.version = CACHE_VERSION;
+		header.keyLength = strlen(key);
+		header.rangeCount = m_rangeIPs.size();
+
+		uLong checksum = crc32(0, (const Bytef*)(const char*)key, header.keyLength);
+		if (header.rangeCount) {
+			checksum = crc32(checksum, (const Bytef*)&m_rangeIPs[0], header.rangeCount * sizeof(uint32));
+			checksum = crc32(checksum, (const Bytef*)&m_rangeLengths[0], header.rangeCount * sizeof(uint16));
+		}
+		header.checksum = checksum;
+
+		// Write to a temporary file first, so a crash can't leave a half-written cache behind
+		const wxString tempName = GetCacheFile() + wxT(".tmp");
+		wxFFile file;
+		if (!file.Open(tempName, wxT("wb"))) {
+			return;
+		}
+
+		bool ok = file.Write(&header, sizeof(header)) == sizeof(header)
+			&& file.Write((const char*)key, header.keyLength) == header.keyLength;
+		if (ok && header.rangeCount) {
+			ok = file.Write(&m_rangeIPs[0], header.rangeCount * sizeof(uint32)) == header.rangeCount * sizeof(uint32)
+				&& file.Write(&m_rangeLengths[0], header.rangeCount * sizeof(uint16)) == header.rangeCount * sizeof(uint16);
+		}
+		ok = file.Close() && ok;
+
+		if (!ok || !wxRenameFile(tempName, GetCacheFile(), true)) {
+			AddDebugLogLineN(logIPFilter, wxT("Failed to write the IP filter cache"));
+			wxRemoveFile(tempName);
+		}
+	}
+
 	/**
 	 * This structure is used to contain the range-data in the rangemap.
 	 */
@@ -225,6 +470,12 @@ private:
 
 	bool m_storeDescriptions;
 
+	// ipfilter.dat was parsed by CIPFilterUpdater
+	bool	m_downloaded;
+	uint32	m_downloadedRanges;
+	uint32	m_downloadedBad;
+	int	m_downloadedLine;
+
 	// the generated filter
 	CIPFilter::RangeIPs m_rangeIPs;
 	CIPFilter::RangeLengths m_rangeLengths;
@@ -282,10 +533,6 @@ private:
 			return 0;
 		}
 
-#ifdef __DEBUG__
-		m_storeDescriptions = theLogger.IsEnabled(logIPFilter);
-#endif
-
 		const wxChar* ipfilter_files[] = {
 			wxT("ipfilter.dat"),
 			wxT("guardian.p2p"),
@@ -301,22 +548,18 @@ private:
 		}
 
 		int filtercount = 0;
-		yyip_Bad = 0;
+		int badcount = 0;
 		wxFFile readFile;
 		if (readFile.Open(path.GetRaw())) {
+			wxMutexLocker lock(s_scannerMutex);
+			yyip_Bad = 0;
 			yyip_Line = 1;
 			yyiprestart(readFile.fp());
-			uint32 IPStart = 0;
-			uint32 IPEnd   = 0;
-			uint32 IPAccessLevel = 0;
-			char * IPDescription;
 #ifdef __DEBUG__
 			uint32 time1 = GetTickCountFullRes();
 #endif
-			while (yyiplex(IPStart, IPEnd, IPAccessLevel, IPDescription)) {
-				AddIPRange(IPStart, IPEnd, IPAccessLevel, IPDescription);
-				filtercount++;
-			}
+			filtercount = Lex();
+			badcount = yyip_Bad;
 #ifdef __DEBUG__
 			uint32 time2 = GetTickCountFullRes();
 			AddDebugLogLineN(logIPFilter, CFormat(wxT("time for lexer: %.3f")) % ((time2-time1) / 1000.0));
@@ -326,14 +569,290 @@ private:
 			return 0;
 		}
 
+		LogLoaded(filtercount, badcount, file);
+
+		return filtercount;
+	}
+
+	/**
+	 * Adds the ranges of a block of complete lines of an ipfilter.dat
+	 * that is being downloaded.
+	 */
+	void AddDownloadedLines(const char* data, uint32 length)
+	{
+		wxMutexLocker lock(s_scannerMutex);
+		yyip_Bad = 0;
+		yyip_Line = m_downloadedLine;
+		yyip_BeginBuffer(data, length);
+		m_downloadedRanges += Lex();
+		yyip_EndBuffer();
+		m_downloadedBad += yyip_Bad;
+		m_downloadedLine = yyip_Line;
+	}
+
+	/**
+	 * Adds all ranges the scanner finds in its current input.
+	 * The caller must hold s_scannerMutex.
+	 *
+	 * @return The number of ranges found.
+	 */
+	int Lex()
+	{
+		int filtercount = 0;
+		uint32 IPStart = 0;
+		uint32 IPEnd   = 0;
+		uint32 IPAccessLevel = 0;
+		char * IPDescription;
+		while (yyiplex(IPStart, IPEnd, IPAccessLevel, IPDescription)) {
+			AddIPRange(IPStart, IPEnd, IPAccessLevel, IPDescription);
+			filtercount++;
+		}
+
+		return filtercount;
+	}
+
+	static void LogLoaded(uint32 filtercount, uint32 badcount, const wxString& file)
+	{
 		wxString msg = CFormat(wxPLURAL("Loaded %u IP-range from '%s'.", "Loaded %u IP-ranges from '%s'.", filtercount)) % filtercount % file;
-		if (yyip_Bad) {
-			msg << wxT(" ") << ( CFormat(wxPLURAL("%u malformed line was discarded.", "%u malformed lines were discarded.", yyip_Bad)) % yyip_Bad );
+		if (badcount) {
+			msg << wxT(" ") << ( CFormat(wxPLURAL("%u malformed line was discarded.", "%u malformed lines were discarded.", badcount)) % badcount );
 		}
 		AddLogLineN(msg);
+	}
+};
 
-		return filtercount;
+
+////////////////////////////////////////////////////////////
+// Handler for ipfilter.dat downloads.
+
+/**
+ * Processes an ipfilter.dat while it is being downloaded.
+ *
+ * Gzipped data is unpacked on the fly, and complete lines are parsed as
+ * they arrive, so the filter is ready as soon as the download is. The
+ * text is written to ipfilter.dat.new, which replaces ipfilter.dat once
+ * the download is complete; the parsed ranges are then handed to a
+ * CIPFilterTask, which only has to add ipfilter_static.dat.
+ *
+ * Zip archives can't be unpacked before they are complete. They are
+ * stored as ipfilter.download, and CIPFilter::DownloadFinished loads
+ * them the usual way.
+ */
+class CIPFilterUpdater : public CHTTPDownloadHandler
+{
+public:
+	CIPFilterUpdater(wxEvtHandler* owner)
+		: m_task(new CIPFilterTask(owner, true)),
+		  m_format(EFT_Unknown),
+		  m_inflating(false),
+		  m_inflateComplete(false)
+	{
+	}
+
+	~CIPFilterUpdater()
+	{
+		delete m_task;
+		if (m_inflating) {
+			inflateEnd(&m_zstream);
+		}
+	}
+
+	static wxString GetDownloadFile()
+	{
+		return thePrefs::GetConfigDir() + wxT("ipfilter.download");
+	}
+
+	bool OnData(const char* data, uint32 length)
+	{
+		if (m_format == EFT_Unknown) {
+			// Wait for enough data to recognize the format
+			m_header.append(data, length);
+			if (m_header.size() < 4) {
+				return true;
+			}
+			return Start();
+		}
+
+		return Process(data, length);
+	}
+
+	bool OnFinished(bool success)
+	{
+		if (success && m_format == EFT_Unknown) {
+			// Less than a handful of bytes
+			success = Start();
+		}
+
+		if (m_format == EFT_Zip) {
+			bool closed = m_output.Close();
+			if (!success || !closed) {
+				wxRemoveFile(GetDownloadFile());
+			}
+			return success && closed;
+		}
+
+		if (success && m_format == EFT_GZip && !m_inflateComplete) {
+			AddLogLineC(_("Downloaded ipfilter.dat archive is truncated."));
+			success = false;
+		}
+		if (success && !m_pendingLine.empty()) {
+			// Last line without line break
+			m_task->AddDownloadedLines(m_pendingLine.data(), m_pendingLine.size());
+		}
+		if (m_output.IsOpened() && !m_output.Close()) {
+			success = false;
+		}
+
+		const wxString datFile = thePrefs::GetConfigDir() + wxT("ipfilter.dat");
+		if (success && !wxRenameFile(GetNewFile(), datFile, true)) {
+			AddLogLineC(CFormat(_("Failed to rename new %s file, aborting update.")) % wxT("ipfilter.dat"));
+			success = false;
+		}
+		if (!success) {
+			if (wxFileExists(GetNewFile())) {
+				wxRemoveFile(GetNewFile());
+			}
+			return false;
+		}
+
+		CIPFilterTask::LogLoaded(m_task->m_downloadedRanges, m_task->m_downloadedBad, datFile);
+		CThreadScheduler::AddTask(m_task);
+		m_task = NULL;
+
+		return true;
+	}
+
+private:
+	static wxString GetNewFile()
+	{
+		return thePrefs::GetConfigDir() + wxT("ipfilter.dat.new");
+	}
+
+	/**
+	 * Picks the format from the first bytes of the download,
+	 * then processes them.
+	 */
+	bool Start()
+	{
+		const std::string header = m_header;
+		m_header.clear();
+
+		wxString outputFile = GetNewFile();
+		if (header.compare(0, 4, "PK\x03\x04") == 0) {
+			m_format = EFT_Zip;
+			outputFile = GetDownloadFile();
+		} else {
+			if (header.size() >= 2 && (uint8)header[0] == 0x1f && (uint8)header[1] == 0x8b) {
+				m_format = EFT_GZip;
+				memset(&m_zstream, 0, sizeof(m_zstream));
+				// Tell zlib to expect a gzip header
+				if (inflateInit2(&m_zstream, MAX_WBITS + 16) != Z_OK) {
+					return false;
+				}
+				m_inflating = true;
+			} else {
+				m_format = EFT_Text;
+			}
+			// Don't let DownloadFinished pick up a leftover
+			if (wxFileExists(GetDownloadFile())) {
+				wxRemoveFile(GetDownloadFile());
+			}
+		}
+
+		if (!m_output.Open(outputFile, wxT("wb"))) {
+			return false;
+		}
+
+		return header.empty() || Process(header.data(), header.size());
+	}
+
+	bool Process(const char* data, uint32 length)
+	{
+		switch (m_format) {
+			case EFT_Zip:
+				return m_output.Write(data, length) == length;
+			case EFT_GZip:
+				return Inflate(data, length);
+			default:
+				return AddText(data, length);
+		}
 	}
+
+	bool Inflate(const char* data, uint32 length)
+	{
+		char buffer[32768];
+
+		m_zstream.next_in = (Bytef*)data;
+		m_zstream.avail_in = length;
+		do {
+			if (m_inflateComplete) {
+				// Another gzip member follows
+				inflateReset(&m_zstream);
+				m_inflateComplete = false;
+			}
+
+			m_zstream.next_out = (Bytef*)buffer;
+			m_zstream.avail_out = sizeof(buffer);
+			int ret = inflate(&m_zstream, Z_NO_FLUSH);
+			if (ret == Z_BUF_ERROR) {
+				// Needs more input
+				break;
+			} else if (ret != Z_OK && ret != Z_STREAM_END) {
+				AddLogLineC(_("Downloaded ipfilter.dat archive is corrupted."));
+				return false;
+			}
+
+			if (!AddText(buffer, sizeof(buffer) - m_zstream.avail_out)) {
+				return false;
+			}
+			m_inflateComplete = ret == Z_STREAM_END;
+		} while (m_zstream.avail_in > 0 || m_zstream.avail_out == 0);
+
+		return true;
+	}
+
+	/**
+	 * Stores a block of text and parses the lines completed by it.
+	 */
+	bool AddText(const char* data, uint32 length)
+	{
+		if (m_output.Write(data, length) != length) {
+			return false;
+		}
+
+		const char* end = data + length;
+		const char* lineStart = end;
+		while (lineStart > data && lineStart[-1] != '\n') {
+			--lineStart;
+		}
+
+		if (lineStart > data) {
+			if (m_pendingLine.empty()) {
+				m_task->AddDownloadedLines(data, lineStart - data);
+			} else {
+				m_pendingLine.append(data, lineStart - data);
+				m_task->AddDownloadedLines(m_pendingLine.data(), m_pendingLine.size());
+				m_pendingLine.clear();
+			}
+		}
+		// The rest is completed by the next block
+		m_pendingLine.append(lineStart, end - lineStart);
+
+		return true;
+	}
+
+	//! Gets the parsed ranges, NULL once it has been scheduled
+	CIPFilterTask*	m_task;
+	EFileType	m_format;
+	//! Beginning of the download, until the format is known
+	std::string	m_header;
+	//! Incomplete last line of the data so far
+	std::string	m_pendingLine;
+	wxFFile		m_output;
+
+	z_stream	m_zstream;
+	bool		m_inflating;
+	bool		m_inflateComplete;
 };
 
 
@@ -367,6 +886,8 @@ static bool CreateDummyFile(const wxString& filename, const wxString& text)
 
 
 CIPFilter::CIPFilter() :
+	m_table(new RangeTable),
+	m_readers(0),
 	m_ready(false),
 	m_startKADWhenReady(false),
 	m_connectToAnyServerWhenReady(false)
@@ -408,11 +929,21 @@ void CIPFilter::Reload()
 }
 
 
+CIPFilter::~CIPFilter()
+{
+	// The networks are down by now, so no more lookups are running.
+	DeleteContents(m_retiredTables);
+	delete m_table;
+}
+
+
 uint32 CIPFilter::BanCount() const
 {
-	wxMutexLocker lock(m_mutex);
+	AtomicAdd(&m_readers, 1);
+	uint32 count = AtomicLoadPtr(const_cast<RangeTable* volatile*>(&m_table))->m_rangeIPs.size();
+	AtomicAdd(&m_readers, -1);
 
-	return m_rangeIPs.size();
+	return count;
 }
 
 
@@ -432,36 +963,21 @@ bool CIPFilter::IsFiltered(uint32 IPTest, bool isServer)
 		}
 		return true;
 	}
-	wxMutexLocker lock(m_mutex);
+	// No locking here, see the atomic helpers at the top of this file.
+	AtomicAdd(&m_readers, 1);
+	const RangeTable* table = AtomicLoadPtr(&m_table);
+	const RangeNames& rangeNames = table->m_rangeNames;
 	// The IP needs to be in host order
-	uint32 ip = wxUINT32_SWAP_ALWAYS(IPTest);
-	int imin = 0;
-	int imax = m_rangeIPs.size() - 1;
-	int i;
-	bool found = false;
-	while (imin <= imax) {
-		i = (imin + imax) / 2;
-		uint32 curIP = m_rangeIPs[i];
-		if (curIP <= ip) {
-			uint32 curLength = m_rangeLengths[i];
-			if (curLength >= 0x8000) {
-				curLength = ((curLength & 0x7fff) << 12) + 0xfff;
-			}
-			if (curIP + curLength >= ip) {
-				found = true;
-				break;
-			}
-		}
-		if (curIP > ip) {
-			imax = i - 1;
-		} else {
-			imin = i + 1;
-		}
-	}
+	int i = table->m_index.Find(table->m_rangeIPs, table->m_rangeLengths, wxUINT32_SWAP_ALWAYS(IPTest));
+	bool found = i >= 0;
 	if (found) {
 		AddDebugLogLineN(logIPFilter, CFormat(wxT("Filtered IP %s%s")) % Uint32toStringIP(IPTest)
-			% (i < (int)m_rangeNames.size() ? (wxT(" (") + wxString(char2unicode(m_rangeNames[i].c_str())) + wxT(")"))
+			% (i < (int)rangeNames.size() ? (wxT(" (") + wxString(char2unicode(rangeNames[i].c_str())) + wxT(")"))
 											: wxString(wxEmptyString)));
+	}
+	AtomicAdd(&m_readers, -1);
+
+	if (found) {
 		if (isServer) {
 			theStats::AddFilteredServer();
 		} else {
@@ -473,6 +989,22 @@ bool CIPFilter::IsFiltered(uint32 IPTest, bool isServer)
 }
 
 
+void CIPFilter::FreeRetiredTables(bool wait)
+{
+	// Lookups take microseconds, so if there are any running
+	// they will be done very soon.
+	for (int tries = wait ? 20 : 1; tries > 0 && !m_retiredTables.empty(); --tries) {
+		if (AtomicAdd(&m_readers, 0) == 0) {
+			// Nobody can still be using a retired table: every lookup
+			// started since the swap sees the current one.
+			DeleteContents(m_retiredTables);
+		} else if (tries > 1) {
+			wxMilliSleep(1);
+		}
+	}
+}
+
+
 void CIPFilter::Update(const wxString& strURL)
 {
 	if (!strURL.IsEmpty()) {
@@ -480,7 +1012,8 @@ void CIPFilter::Update(const wxString& strURL)
 
 		wxString filename = thePrefs::GetConfigDir() + wxT("ipfilter.download");
 		wxString oldfilename = thePrefs::GetConfigDir() + wxT("ipfilter.dat");
-		CHTTPDownloadThread *downloader = new CHTTPDownloadThread(m_URL, filename, oldfilename, HTTP_IPFilter, true, true);
+		// The download is parsed while it arrives
+		CHTTPDownloadThread *downloader = new CHTTPDownloadThread(m_URL, filename, oldfilename, HTTP_IPFilter, true, true, new CIPFilterUpdater(this));
 
 		downloader->Create();
 		downloader->Run();
@@ -491,12 +1024,17 @@ void CIPFilter::Update(const wxString& strURL)
 void CIPFilter::DownloadFinished(uint32 result)
 {
 	wxString datName = wxT("ipfilter.dat");
+	bool reload = false;
 	if (result == HTTP_Success) {
 		// download succeeded. proceed with ipfilter loading
-		wxString newDat = thePrefs::GetConfigDir() + wxT("ipfilter.download");
+		wxString newDat = CIPFilterUpdater::GetDownloadFile();
 		wxString oldDat = thePrefs::GetConfigDir() + datName;
 
-		if (wxFileExists(oldDat) && !wxRemoveFile(oldDat)) {
+		if (!wxFileExists(newDat)) {
+			// Already parsed and installed by CIPFilterUpdater,
+			// the new filter is being generated.
+			AddLogLineN(CFormat(_("Successfully updated %s")) % datName);
+		} else if (wxFileExists(oldDat) && !wxRemoveFile(oldDat)) {
 			AddLogLineC(CFormat(_("Failed to remove %s file, aborting update.")) % datName);
 			result = HTTP_Error;
 		} else if (!wxRenameFile(newDat, oldDat)) {
@@ -504,6 +1042,7 @@ void CIPFilter::DownloadFinished(uint32 result)
 			result = HTTP_Error;
 		} else {
 			AddLogLineN(CFormat(_("Successfully updated %s")) % datName);
+			reload = true;
 		}
 	// cppcheck-suppress duplicateBranch
 	} else if (result == HTTP_Skipped) {
@@ -512,7 +1051,7 @@ void CIPFilter::DownloadFinished(uint32 result)
 		AddLogLineC(CFormat(_("Failed to download %s from %s")) % datName % m_URL);
 	}
 
-	if (result == HTTP_Success) {
+	if (reload) {
 		// Reload both ipfilter files on success
 		Reload();
 	}
@@ -521,13 +1060,18 @@ void CIPFilter::DownloadFinished(uint32 result)
 
 void CIPFilter::OnIPFilterEvent(CIPFilterEvent& evt)
 {
-	{
-		wxMutexLocker lock(m_mutex);
-		std::swap(m_rangeIPs, evt.m_rangeIPs);
-		std::swap(m_rangeLengths, evt.m_rangeLengths);
-		std::swap(m_rangeNames, evt.m_rangeNames);
-		m_ready = true;
-	}
+	RangeTable* table = new RangeTable;
+	std::swap(table->m_rangeIPs, evt.m_rangeIPs);
+	std::swap(table->m_rangeLengths, evt.m_rangeLengths);
+	std::swap(table->m_rangeNames, evt.m_rangeNames);
+	table->m_index.Build(table->m_rangeIPs);
+
+	// Publish the new table. Lookups still running on the old one may
+	// finish undisturbed, it is freed once they're done.
+	m_retiredTables.push_back(AtomicExchangePtr(&m_table, table));
+	FreeRetiredTables(true);
+	m_ready = true;
+
 	if (theApp->IsOnShutDown()) {
 		return;
 	}
@@ -29,6 +29,9 @@
 #include <wx/event.h>	// Needed for wxEvent
 
 #include "Types.h"	// Needed for uint8, uint16 and uint32
+#include "IPFilterIndex.h"	// Needed for CIPFilterIndex
+
+#include <list>
 
 class CIPFilterEvent;
 
@@ -51,6 +54,11 @@ public:
 	 */
 	CIPFilter();
 
+	/**
+	 * Destructor.
+	 */
+	~CIPFilter();
+
 	/**
 	 * Checks if a IP is filtered with the current list and AccessLevel.
 	 *
@@ -107,17 +115,40 @@ private:
 	wxString m_URL;
 
 	// The IP ranges
-	typedef std::vector<uint32> RangeIPs;
-	RangeIPs m_rangeIPs;
-	typedef std::vector<uint16> RangeLengths;
-	RangeLengths m_rangeLengths;
+	typedef CIPFilterIndex::RangeIPs RangeIPs;
+	typedef CIPFilterIndex::RangeLengths RangeLengths;
+
 	// Name for each range. This usually stays empty for memory reasons,
 	// except if IP-Filter debugging is active.
 	typedef std::vector<std::string> RangeNames;
-	RangeNames m_rangeNames;
 
-	//! Mutex used to ensure thread-safety of this class
-	mutable wxMutex	m_mutex;
+	/**
+	 * A complete set of filtered ranges. Once published in m_table, a
+	 * table is never modified, which is what allows lookups to go
+	 * without locking.
+	 */
+	struct RangeTable
+	{
+		RangeIPs	m_rangeIPs;
+		RangeLengths	m_rangeLengths;
+		RangeNames	m_rangeNames;
+		CIPFilterIndex	m_index;
+	};
+
+	/**
+	 * Deletes the tables replaced by a reload, once no lookup can be
+	 * reading them anymore.
+	 *
+	 * @param wait Wait a little for running lookups if needed.
+	 */
+	void	FreeRetiredTables(bool wait);
+
+	//! The current table. Only ever replaced as a whole, never NULL.
+	RangeTable* volatile	m_table;
+	//! Number of lookups currently reading m_table.
+	mutable volatile long	m_readers;
+	//! Replaced tables that may still be in use. Only touched from the main thread.
+	std::list<RangeTable*>	m_retiredTables;
 
 	// false if loading (on startup only)
 	bool m_ready;
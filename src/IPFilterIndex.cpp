@@ -0,0 +1,142 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+#include "IPFilterIndex.h"	// Interface declarations
+
+
+// Number of entries in the first level, one per /16 network plus an end marker.
+static const uint32 FIRST_LEVEL_SIZE = 0x10000 + 1;
+
+
+uint32 CIPFilterIndex::AppendRange(RangeIPs& rangeIPs, RangeLengths& rangeLengths, uint32 startIP, uint32 endIP)
+{
+	// Calculate range "length"
+	// (which is included-end - start and thus length - 1)
+	// Encoding:
+	// 0      - 0x7fff	same
+	// 0x8000 - 0xffff	0xfff	- 0x07ffffff
+	// that means: remove msb, shift left by 12 bit, add 0xfff
+	// so it can cover 8 consecutive class A nets
+	// larger ranges (or theoretical ranges with uneven ends) have to be split
+	uint64 realLength = (uint64)endIP - startIP + 1;
+	uint32 parts = 0;
+
+	while (realLength) {
+		rangeIPs.push_back(startIP);
+		uint32 curLength;
+		uint16 pushLength;
+		if (realLength <= 0x8000) {
+			curLength = realLength;
+			pushLength = curLength - 1;
+		} else {
+			if (realLength >= 0x08000000) {
+				// range to big, limit
+				curLength = 0x08000000;
+			} else {
+				// cut off LSBs
+				curLength = realLength & 0x07FFF000;
+			}
+			pushLength = ((curLength - 1) >> 12) | 0x8000;
+		}
+		rangeLengths.push_back(pushLength);
+		realLength -= curLength;
+		startIP += curLength;
+		++parts;
+	}
+
+	return parts;
+}
+
+
+void CIPFilterIndex::Build(const RangeIPs& rangeIPs)
+{
+	m_firstLevel.resize(FIRST_LEVEL_SIZE);
+
+	uint32 range = 0;
+	for (uint32 net = 0; net < FIRST_LEVEL_SIZE; ++net) {
+		uint64 netStart = (uint64)net << 16;
+		while (range < rangeIPs.size() && rangeIPs[range] < netStart) {
+			++range;
+		}
+		m_firstLevel[net] = range;
+	}
+}
+
+
+int CIPFilterIndex::Find(const RangeIPs& rangeIPs, const RangeLengths& rangeLengths, uint32 ip) const
+{
+	if (m_firstLevel.empty()) {
+		return BinarySearch(rangeIPs, rangeLengths, ip);
+	}
+
+	// Only the ranges starting in the same /16 network can start closer to
+	// the address than the last range starting before that network.
+	uint32 net = ip >> 16;
+	uint32 imin = m_firstLevel[net];
+	uint32 imax = m_firstLevel[net + 1];
+
+	// Find the first range starting after the address
+	while (imin < imax) {
+		uint32 i = (imin + imax) / 2;
+		if (rangeIPs[i] <= ip) {
+			imin = i + 1;
+		} else {
+			imax = i;
+		}
+	}
+
+	// Ranges don't overlap, so only the one before it can contain the address
+	if (imin == 0) {
+		return -1;
+	}
+	uint32 i = imin - 1;
+	if (ip - rangeIPs[i] <= DecodeLength(rangeLengths[i])) {
+		return i;
+	}
+
+	return -1;
+}
+
+
+int CIPFilterIndex::BinarySearch(const RangeIPs& rangeIPs, const RangeLengths& rangeLengths, uint32 ip)
+{
+	int imin = 0;
+	int imax = rangeIPs.size() - 1;
+	while (imin <= imax) {
+		int i = (imin + imax) / 2;
+		uint32 curIP = rangeIPs[i];
+		if (curIP <= ip) {
+			if (curIP + DecodeLength(rangeLengths[i]) >= ip) {
+				return i;
+			}
+			imin = i + 1;
+		} else {
+			imax = i - 1;
+		}
+	}
+
+	return -1;
+}
+// File_checked_for_headers
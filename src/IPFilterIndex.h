@@ -0,0 +1,98 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+#ifndef IPFILTERINDEX_H
+#define IPFILTERINDEX_H
+
+#include "Types.h"		// Needed for uint16 and uint32
+
+#include <vector>
+
+
+/**
+ * Lookup index for the ranges of the IP filter.
+ *
+ * The ranges are kept as two parallel arrays sorted by start address: the
+ * start IPs, and their lengths packed into 16 bits (see AppendRange). The
+ * ranges never overlap. A plain binary search over a large list touches a
+ * new cache line at almost every step, so this index adds a first level
+ * that is directly indexed by the upper 16 bits of the address. It leaves
+ * only the few ranges starting in the same /16 network to be searched,
+ * which usually fit into one or two cache lines.
+ */
+class CIPFilterIndex
+{
+public:
+	typedef std::vector<uint32> RangeIPs;
+	typedef std::vector<uint16> RangeLengths;
+
+	/**
+	 * Appends a range to the arrays, splitting it into several parts if
+	 * its length can't be stored in one.
+	 *
+	 * @param rangeIPs The start addresses.
+	 * @param rangeLengths The encoded lengths.
+	 * @param startIP First address of the range, in host order.
+	 * @param endIP Last address of the range, in host order.
+	 * @return The number of parts the range was stored in.
+	 */
+	static uint32	AppendRange(RangeIPs& rangeIPs, RangeLengths& rangeLengths, uint32 startIP, uint32 endIP);
+
+	/**
+	 * Returns the offset of the last address of a range from its start.
+	 */
+	static uint32	DecodeLength(uint16 length)
+	{
+		return length >= 0x8000 ? ((uint32)(length & 0x7fff) << 12) + 0xfff : length;
+	}
+
+	/**
+	 * Creates the index for the given ranges, which must be sorted
+	 * and must not overlap. The index must be rebuilt whenever the
+	 * ranges change.
+	 */
+	void	Build(const RangeIPs& rangeIPs);
+
+	/**
+	 * Finds the range containing an address.
+	 *
+	 * @param ip The address, in host order.
+	 * @return The index of the range, or -1 if the address isn't in any.
+	 */
+	int	Find(const RangeIPs& rangeIPs, const RangeLengths& rangeLengths, uint32 ip) const;
+
+	/**
+	 * Same as Find, but using a binary search over all ranges without the
+	 * index. Only useful for comparison.
+	 */
+	static int	BinarySearch(const RangeIPs& rangeIPs, const RangeLengths& rangeLengths, uint32 ip);
+
+private:
+	//! For each /16 network, the index of the first range starting at or after it.
+	std::vector<uint32>	m_firstLevel;
+};
+
+#endif // IPFILTERINDEX_H
+// File_checked_for_headers
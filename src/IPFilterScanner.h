@@ -34,6 +34,12 @@
 YY_DECL;
 void yyiprestart(FILE *new_file);
 
+// Lex from memory instead of a file: call yyip_BeginBuffer(), then
+// yyiplex() until it returns 0, then yyip_EndBuffer().
+// The data is copied, so it may be freed right away.
+void yyip_BeginBuffer(const char * bytes, int length);
+void yyip_EndBuffer();
+
 IPFS_EXTERN int yyip_Bad;
 IPFS_EXTERN int yyip_Line;
 
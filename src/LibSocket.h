@@ -164,6 +164,12 @@ public:
 
 	// Do we have a socket available if AcceptWith() is called ?
 	bool	SocketAvailable();
+
+	// IP of the connection AcceptWith() would accept next, 0 if none
+	uint32	GetPendingPeerIP();
+
+	// Close the connection AcceptWith() would accept next, without creating a socket object for it
+	bool	RejectPending();
 private:
 	class CAsioSocketServerImpl * m_aServer;
 };
@@ -342,6 +348,18 @@ public:
 
 	bool SocketAvailable() { return true; }
 
+	// wx doesn't tell the peer before accepting
+	uint32 GetPendingPeerIP() { return 0; }
+
+	bool RejectPending()
+	{
+		wxSocketBase * socket = wxSocketServer::Accept(false);
+		if (socket) {
+			socket->Destroy();
+		}
+		return socket != NULL;
+	}
+
 	virtual	void OnAccept() {}
 };
 
@@ -822,6 +822,38 @@ public:
 
 		// check if we have another socket ready for reception
 		m_currentSocket.reset(new CAsioSocketImpl(NULL));
+		AcceptNext();
+
+		return true;
+	}
+
+	bool SocketAvailable() const { return m_socketAvailable; }
+
+	uint32 GetPendingPeerIP() const
+	{
+		return m_socketAvailable ? m_currentSocket->GetPeerInt() : 0;
+	}
+
+	bool RejectPending()
+	{
+		if (!m_socketAvailable) {
+			return false;
+		}
+
+		// Close the connection, and reuse the socket object for the next one
+		error_code ec;
+		m_currentSocket->GetAsioSocket().close(ec);
+		AcceptNext();
+
+		return true;
+	}
+
+private:
+
+	// Check if we have another socket ready for reception,
+	// or else start waiting for one in background.
+	void AcceptNext()
+	{
 		error_code ec;
 		// async_accept does not work if server is non-blocking
 		// temporarily switch it to non-blocking
@@ -830,31 +862,33 @@ public:
 		accept(m_currentSocket->GetAsioSocket(), ec);
 		// back to blocking
 		non_blocking(false);
-		if (ec || !m_currentSocket->UpdateIP()) {
+		if (ec) {
 			// nothing there
 			m_socketAvailable = false;
 			// start getting another one
+			WaitForAccept();
+			AddDebugLogLineF(logAsio, wxT("AcceptNext: getting another socket in background"));
+		} else if (!m_currentSocket->UpdateIP()) {
+			m_socketAvailable = false;
 			StartAccept();
-			AddDebugLogLineF(logAsio, wxT("AcceptWith: ok, getting another socket in background"));
 		} else {
 			// we got another socket right away
 			m_socketAvailable = true;	// it is already true, but this improves readability
-			AddDebugLogLineF(logAsio, wxT("AcceptWith: ok, another socket is available"));
+			AddDebugLogLineF(logAsio, wxT("AcceptNext: another socket is available"));
 			// aMule actually doesn't need a notification as it polls the listen socket.
 			// amuleweb does need it though
 			CoreNotify_ServerTCPAccept(m_libSocketServer);
 		}
-
-		return true;
 	}
 
-	bool SocketAvailable() const { return m_socketAvailable; }
-
-private:
-
 	void StartAccept()
 	{
 		m_currentSocket.reset(new CAsioSocketImpl(NULL));
+		WaitForAccept();
+	}
+
+	void WaitForAccept()
+	{
 		async_accept(m_currentSocket->GetAsioSocket(),
 			m_strand.wrap(boost::bind(& CAsioSocketServerImpl::HandleAccept, this, placeholders::error)));
 	}
@@ -938,6 +972,18 @@ bool CLibSocketServer::SocketAvailable()
 }
 
 
+uint32 CLibSocketServer::GetPendingPeerIP()
+{
+	return m_aServer->GetPendingPeerIP();
+}
+
+
+bool CLibSocketServer::RejectPending()
+{
+	return m_aServer->RejectPending();
+}
+
+
 /**
  * ASIO UDP socket implementation
  */
@@ -1102,12 +1148,34 @@ private:
 			AddDebugLogLineF(logAsio, CFormat(wxT("UDP HandleRead %d %s:%d")) % received % ipadr.IPAddress() % ipadr.Service());
 
 			// create our read buffer
-			CUDPData * recdata = new CUDPData(m_readBuffer, received, ipadr);
+			std::list<CUDPData *> batch;
+			batch.push_back(new CUDPData(m_readBuffer, received, ipadr));
+
+			// Pick up whatever else is already waiting, so a burst of datagrams
+			// costs a single wakeup instead of one per datagram.
+			while (batch.size() < CMuleUDPSocket::UDP_RECEIVE_BATCH) {
+				error_code ec2;
+				if (m_socket->available(ec2) == 0 || ec2) {
+					break;
+				}
+				size_t more = m_socket->receive_from(buffer(m_readBuffer, CMuleUDPSocket::UDP_BUFFER_SIZE), m_receiveEndpoint, 0, ec2);
+				if (ec2 || more == 0) {
+					break;
+				}
+				batch.push_back(new CUDPData(m_readBuffer, more, amuleIPV4Address(CamuleIPV4Endpoint(m_receiveEndpoint))));
+			}
+
+			bool notify;
 			{
 				wxMutexLocker lock(m_receiveBuffersLock);
-				m_receiveBuffers.push_back(recdata);
+				// The core drains the whole queue on a notification, so only
+				// notify if it doesn't have one pending already.
+				notify = m_receiveBuffers.empty();
+				m_receiveBuffers.splice(m_receiveBuffers.end(), batch);
+			}
+			if (notify) {
+				CoreNotify_UDPSocketReceive(m_muleSocket);
 			}
-			CoreNotify_UDPSocketReceive(m_muleSocket);
 		}
 		StartBackgroundRead();
 	}
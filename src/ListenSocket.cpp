@@ -27,12 +27,24 @@
 
 #include <common/EventIDs.h>
 
+#include <algorithm>		// Needed for std::min
+
 #include "ClientTCPSocket.h"	// Needed for CClientRequestSocket
 #include "Logger.h"			// Needed for AddLogLineM
 #include "Statistics.h"		// Needed for theStats
 #include "Preferences.h"	// Needed for CPreferences
 #include "amule.h"		// Needed for theApp
 #include "ServerConnect.h"	// Needed for CServerConnect
+#include "IPFilter.h"		// Needed for CIPFilter
+#include "ClientList.h"		// Needed for CClientList
+#include "GetTickCount.h"	// Needed for GetTickCount
+#include "NetworkFunctions.h"	// Needed for Uint32toStringIP
+
+
+// Connection attempts an IP may make in a row
+static const uint32 CONNECT_BURST = 8;
+// Time until an IP may make another attempt, in ms
+static const uint32 CONNECT_REFILL_TIME = 4000;
 
 //-----------------------------------------------------------------------------
 // CListenSocket
@@ -56,6 +68,10 @@ CSocketServerProxy(addr, MULE_SOCKET_NOWAIT|MULE_SOCKET_REUSEADDR, ProxyData)
 	totalconnectionchecks = 0;
 	averageconnections = 0.0;
 	memset(m_ConnectionStates, 0, 3 * sizeof(m_ConnectionStates[0]));
+	m_lastBucketPrune = GetTickCount();
+	m_rejectedFiltered = 0;
+	m_rejectedBanned = 0;
+	m_rejectedFlooding = 0;
 	// Set the listen socket event handler -- The handler is written in amule.cpp
 	if (IsOk()) {
 #ifndef ASIO_SOCKETS
@@ -97,6 +113,16 @@ void CListenSocket::OnAccept()
 	while (m_pending && (theApp->serverconnect->IsConnecting() || !TooManySockets())) {
 		if (!SocketAvailable()) {
 			m_pending = false;
+			continue;
+		}
+
+		// If the socket layer tells the peer before accepting, unwanted
+		// connections are dropped before any socket object is created.
+		uint32 ip = GetPendingPeerIP();
+		if (ip && !AdmitConnection(ip)) {
+			if (!RejectPending()) {
+				m_pending = false;
+			}
 		} else {
 			// Create a new socket to deal with the connection
 			CClientTCPSocket* newclient = new CClientTCPSocket();
@@ -105,7 +131,7 @@ void CListenSocket::OnAccept()
 				newclient->Safe_Delete();
 				m_pending = false;
 			} else {
-				if (!newclient->InitNetworkData()) {
+				if (!newclient->InitNetworkData() || (!ip && !AdmitConnection(newclient->GetPeerInt()))) {
 					// IP or port were not returned correctly
 					// from the accepted address, or filtered.
 					newclient->Safe_Delete();
@@ -118,6 +144,67 @@ void CListenSocket::OnAccept()
 	}
 }
 
+/**
+ * Decides if an incoming connection from the given IP is wanted at all.
+ * Rejects filtered and banned IPs, and IPs that connect too often.
+ */
+bool CListenSocket::AdmitConnection(uint32 ip)
+{
+	if (theApp->ipfilter->IsFiltered(ip)) {
+		AddDebugLogLineN(logClient, wxT("Denied connection from ") + Uint32toStringIP(ip) + wxT("(Filtered IP)"));
+		m_rejectedFiltered++;
+		return false;
+	} else if (theApp->clientlist->IsBannedClient(ip)) {
+		AddDebugLogLineN(logClient, wxT("Denied connection from ") + Uint32toStringIP(ip) + wxT("(Banned IP)"));
+		m_rejectedBanned++;
+		return false;
+	}
+
+	const uint32 now = GetTickCount();
+	ConnectionBucket fresh = { CONNECT_BURST, now };
+	std::pair<ConnectionBucketMap::iterator, bool> result = m_connectionBuckets.insert(ConnectionBucketMap::value_type(ip, fresh));
+	ConnectionBucket& bucket = result.first->second;
+	if (!result.second) {
+		uint32 refill = (now - bucket.lastRefill) / CONNECT_REFILL_TIME;
+		if (refill) {
+			bucket.tokens = std::min(CONNECT_BURST, bucket.tokens + refill);
+			bucket.lastRefill += refill * CONNECT_REFILL_TIME;
+		}
+	}
+
+	if (bucket.tokens == 0) {
+		AddDebugLogLineN(logClient, wxT("Denied connection from ") + Uint32toStringIP(ip) + wxT("(Too many connections)"));
+		m_rejectedFlooding++;
+		return false;
+	}
+	if (bucket.tokens == CONNECT_BURST) {
+		// Time starts running with the first token taken
+		bucket.lastRefill = now;
+	}
+	bucket.tokens--;
+
+	return true;
+}
+
+
+/**
+ * Forgets the IPs whose bucket has filled up again.
+ */
+void CListenSocket::PruneConnectionBuckets()
+{
+	const uint32 now = GetTickCount();
+	for (ConnectionBucketMap::iterator it = m_connectionBuckets.begin(); it != m_connectionBuckets.end(); ) {
+		const ConnectionBucket& bucket = it->second;
+		if (now - bucket.lastRefill >= (CONNECT_BURST - bucket.tokens) * CONNECT_REFILL_TIME) {
+			m_connectionBuckets.erase(it++);
+		} else {
+			++it;
+		}
+	}
+	m_lastBucketPrune = now;
+}
+
+
 void CListenSocket::AddConnection()
 {
 	m_OpenSocketsInterval++;
@@ -138,6 +225,10 @@ void CListenSocket::Process()
 	if (m_pending) {
 		OnAccept();
 	}
+
+	if (GetTickCount() - m_lastBucketPrune > CONNECT_BURST * CONNECT_REFILL_TIME) {
+		PruneConnectionBuckets();
+	}
 }
 
 void CListenSocket::RecalculateStats()
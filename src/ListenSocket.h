@@ -32,6 +32,7 @@
 
 #include "Proxy.h"		// Needed fot CProxyData, CSocketServerProxy
 
+#include <map>
 #include <set>
 
 class CClientTCPSocket;
@@ -60,7 +61,32 @@ public:
 
 	bool	OnShutdown() { return shutdown;}
 
+	//! Incoming connections turned away because of the IP filter
+	uint64	GetRejectedFiltered() const	{ return m_rejectedFiltered; }
+	//! Incoming connections turned away because the client is banned
+	uint64	GetRejectedBanned() const	{ return m_rejectedBanned; }
+	//! Incoming connections turned away because the IP connected too often
+	uint64	GetRejectedFlooding() const	{ return m_rejectedFlooding; }
+
 private:
+	bool	AdmitConnection(uint32 ip);
+	void	PruneConnectionBuckets();
+
+	/**
+	 * Token bucket limiting the connection attempts of one IP.
+	 * Each attempt takes a token, tokens come back at a fixed rate.
+	 */
+	struct ConnectionBucket {
+		uint32	tokens;
+		uint32	lastRefill;
+	};
+	typedef std::map<uint32, ConnectionBucket> ConnectionBucketMap;
+	ConnectionBucketMap m_connectionBuckets;
+	uint32	m_lastBucketPrune;
+
+	uint64	m_rejectedFiltered;
+	uint64	m_rejectedBanned;
+	uint64	m_rejectedFlooding;
 
 	typedef std::set<CClientTCPSocket *> SocketSet;
 	SocketSet socket_list;
@@ -41,6 +41,16 @@
 #include "kademlia/kademlia/Prefs.h"
 #include "ClientList.h"
 #include "Preferences.h"
+#include "GuiEvents.h"			// Needed for CoreNotify_UDPSocketReceive
+
+
+// Batch statistics, shared by all UDP sockets. Receiving happens on the
+// main thread, sending on the UBT thread.
+static wxMutex	s_batchStatsMutex;
+static uint64	s_receiveEvents = 0;
+static uint64	s_receivedPackets = 0;
+static uint64	s_sendBatches = 0;
+static uint64	s_sentPackets = 0;
 
 
 CMuleUDPSocket::CMuleUDPSocket(const wxString& name, int id, const amuleIPV4Address& address, const CProxyData* ProxyData)
@@ -139,12 +149,6 @@ void CMuleUDPSocket::OnReceive(int errorCode)
 	AddDebugLogLineN(logMuleUDP, CFormat(wxT("Got UDP callback for read: Error %i Socket state %i"))
 		% errorCode % Ok());
 
-	char buffer[UDP_BUFFER_SIZE];
-	amuleIPV4Address addr;
-	unsigned length = 0;
-	bool error = false;
-	int lastError = 0;
-
 	{
 		wxMutexLocker lock(m_mutex);
 
@@ -154,17 +158,68 @@ void CMuleUDPSocket::OnReceive(int errorCode)
 
 			return;
 		}
+	}
+
+	ReceivePending();
+}
 
 
+void CMuleUDPSocket::ReceivePending()
+{
+	// Drain what has piled up, rather than handling one datagram per event.
+	// The limit keeps a flood from starving the rest of the main loop.
+	unsigned received = 0;
+	while (received < UDP_RECEIVE_BATCH && ReceiveOne()) {
+		++received;
+	}
+
+	if (received) {
+		wxMutexLocker lock(s_batchStatsMutex);
+		++s_receiveEvents;
+		s_receivedPackets += received;
+	}
+
+#ifdef ASIO_SOCKETS
+	// Asio only notifies when the receive queue was empty, so come back
+	// for the rest if we stopped early.
+	if (received == UDP_RECEIVE_BATCH) {
+		CoreNotify_UDPSocketReceive(this);
+	}
+#endif
+}
+
+
+bool CMuleUDPSocket::ReceiveOne()
+{
+	char buffer[UDP_BUFFER_SIZE];
+	amuleIPV4Address addr;
+	unsigned length = 0;
+	bool error = false;
+	int lastError = 0;
+
+	{
+		wxMutexLocker lock(m_mutex);
+
+		// The socket may have been recreated by the previous datagram
+		if ((m_socket == NULL) || !m_socket->IsOk()) {
+			return false;
+		}
+
 		length = m_socket->RecvFrom(addr, buffer, UDP_BUFFER_SIZE);
 		lastError = m_socket->LastError();
 		error = lastError != 0;
 	}
 
+	if (!error && length == 0) {
+		// Would block, nothing more to read
+		return false;
+	}
+
 	const uint32 ip = StringIPtoUint32(addr.IPAddress());
 	const uint16 port = addr.Service();
 	if (error) {
 		OnReceiveError(lastError, ip, port);
+		return false;
 	} else if (length < 2) {
 		// 2 bytes (protocol and opcode) is the smallets possible packet.
 		AddDebugLogLineN(logMuleUDP, m_name + wxT(": Invalid Packet received"));
@@ -182,6 +237,8 @@ void CMuleUDPSocket::OnReceive(int errorCode)
 			<< length << wxT("b"));
 		OnPacketReceived(ip, port, (byte*)buffer, length);
 	}
+
+	return true;
 }
 
 
@@ -265,6 +322,7 @@ SocketSentBytes CMuleUDPSocket::SendControlData(uint32 maxNumberOfBytesToSend, u
 {
 	wxMutexLocker lock(m_mutex);
 	uint32 sentBytes = 0;
+	uint32 sentPackets = 0;
 	while (!m_queue.empty() && !m_busy && (sentBytes < maxNumberOfBytesToSend)) {
 		UDPPack item = m_queue.front();
 		CPacket* packet = item.packet;
@@ -280,6 +338,7 @@ SocketSentBytes CMuleUDPSocket::SendControlData(uint32 maxNumberOfBytesToSend, u
 
 			if (SendTo(sendbuffer, len, item.IP, item.port)) {
 				sentBytes += len;
+				++sentPackets;
 				m_queue.pop_front();
 				delete packet;
 				delete [] sendbuffer;
@@ -296,6 +355,11 @@ SocketSentBytes CMuleUDPSocket::SendControlData(uint32 maxNumberOfBytesToSend, u
 	if (!m_busy && !m_queue.empty()) {
 		theApp->uploadBandwidthThrottler->QueueForSendingControlPacket(this);
 	}
+	if (sentPackets) {
+		wxMutexLocker statsLock(s_batchStatsMutex);
+		++s_sendBatches;
+		s_sentPackets += sentPackets;
+	}
 	SocketSentBytes returnVal = { true, 0, sentBytes };
 
 	return returnVal;
@@ -340,4 +404,18 @@ bool CMuleUDPSocket::SendTo(uint8_t *buffer, uint32_t length, uint32_t ip, uint1
 	return sent;
 }
 
+
+double CMuleUDPSocket::GetAverageReceiveBatch()
+{
+	wxMutexLocker lock(s_batchStatsMutex);
+	return s_receiveEvents ? (double)s_receivedPackets / s_receiveEvents : 0.0;
+}
+
+
+double CMuleUDPSocket::GetAverageSendBatch()
+{
+	wxMutexLocker lock(s_batchStatsMutex);
+	return s_sendBatches ? (double)s_sentPackets / s_sendBatches : 0.0;
+}
+
 // File_checked_for_headers
@@ -96,6 +96,13 @@ public:
 	/** This function is called when the socket is lost (see comments in func.) */
 	virtual void OnDisconnected(int errorCode);
 
+	/**
+	 * Handles the datagrams waiting on the socket without waiting for the
+	 * next receive event. This lets the core timer answer Kad requests in
+	 * between its longer tasks.
+	 */
+	void	ReceivePending();
+
 	/**
 	 * Queues a packet for sending.
 	 *
@@ -122,6 +129,13 @@ public:
 
 	/** Read buffer size */
 	static const unsigned UDP_BUFFER_SIZE = 16384;
+	/** Maximum number of datagrams handled per receive event */
+	static const unsigned UDP_RECEIVE_BATCH = 64;
+
+	/** Average number of datagrams read per receive event, over all UDP sockets. */
+	static double	GetAverageReceiveBatch();
+	/** Average number of datagrams sent per call of SendControlData, over all UDP sockets. */
+	static double	GetAverageSendBatch();
 
 protected:
 	/**
@@ -149,6 +163,14 @@ private:
 	bool	SendTo(uint8_t *buffer, uint32_t length, uint32_t ip, uint16_t port);
 
 
+	/**
+	 * Reads and dispatches a single datagram.
+	 *
+	 * @return false if there was nothing left to read.
+	 */
+	bool	ReceiveOne();
+
+
 	/**
 	 * Creates a new socket.
 	 *
@@ -33,6 +33,7 @@
 #include "MemFile.h"			// Needed for CMemFile
 #include "OtherStructs.h"		// Needed for Header_Struct
 #include "ArchSpecific.h"		// Needed for ENDIAN_*
+#include "PacketBufferPool.h"		// Needed for CPacketBufferPool
 
 // Copy constructor
 CPacket::CPacket(CPacket &p)
@@ -44,6 +45,7 @@ CPacket::CPacket(CPacket &p)
 	m_bLastSplitted = p.m_bLastSplitted;
 	m_bPacked	= p.m_bPacked;
 	m_bFromPF	= p.m_bFromPF;
+	m_bPooledBuffer	= false;
 	memcpy(head, p.head, sizeof head);
 	tempbuffer	= NULL;
 	if (p.completebuffer) {
@@ -70,6 +72,7 @@ CPacket::CPacket(uint8 protocol)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= false;
+	m_bPooledBuffer	= false;
 	memset(head, 0, sizeof head);
 	tempbuffer	= NULL;
 	completebuffer	= NULL;
@@ -88,6 +91,7 @@ CPacket::CPacket(byte* rawHeader, byte *buf)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= false;
+	m_bPooledBuffer	= true;
 	tempbuffer	= NULL;
 	completebuffer	= NULL;
 	pBuffer	= buf;
@@ -102,6 +106,7 @@ CPacket::CPacket(const CMemFile& datafile, uint8 protocol, uint8 ucOpcode)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= false;
+	m_bPooledBuffer	= false;
 	memset(head, 0, sizeof head);
 	tempbuffer = NULL;
 	completebuffer = new byte[size + sizeof(Header_Struct)/*Why this 4?*/];
@@ -123,6 +128,7 @@ CPacket::CPacket(int8 in_opcode, uint32 in_size, uint8 protocol, bool bFromPF)
 	m_bLastSplitted = false;
 	m_bPacked	= false;
 	m_bFromPF	= bFromPF;
+	m_bPooledBuffer	= false;
 	memset(head, 0, sizeof head);
 	tempbuffer	= NULL;
 	if (in_size) {
@@ -145,6 +151,7 @@ CPacket::CPacket(byte* pPacketPart, uint32 nSize, bool bLast, bool bFromPF)
 	m_bLastSplitted	= bLast;
 	m_bPacked	= false;
 	m_bFromPF	= bFromPF;
+	m_bPooledBuffer	= false;
 	memset(head, 0, sizeof head);
 	tempbuffer	= NULL;
 	completebuffer	= pPacketPart;
@@ -156,6 +163,9 @@ CPacket::~CPacket()
 	// Never deletes pBuffer when completebuffer is not NULL
 	if (completebuffer) {
 		delete [] completebuffer;
+	} else if (m_bPooledBuffer) {
+		// Received packet, recycle the buffer
+		CPacketBufferPool::Release(pBuffer);
 	} else if (pBuffer) {
 	// On the other hand, if completebuffer is NULL and pBuffer is not NULL
 		delete [] pBuffer;
@@ -296,7 +306,12 @@ bool CPacket::UnPackPacket(uint32 uMaxDecompressedSize) {
 		wxASSERT( pBuffer != NULL );
 
 		size = unpackedsize;
-		delete[] pBuffer;
+		if (m_bPooledBuffer) {
+			CPacketBufferPool::Release(pBuffer);
+			m_bPooledBuffer = false;
+		} else {
+			delete[] pBuffer;
+		}
 		pBuffer = unpack;
 		prot = OP_EMULEPROT;
 		return true;
@@ -318,4 +333,11 @@ void CPacket::CopyUInt32ToDataBuffer(uint32 data, unsigned int offset)
 	wxCHECK_RET(offset <= size - sizeof(uint32), wxT("Bad offset in CopyUInt32ToDataBuffer."));
 	PokeUInt32( pBuffer + offset, data );
 }
+
+
+void CPacket::CopyUInt64ToDataBuffer(uint64 data, unsigned int offset)
+{
+	wxCHECK_RET(offset <= size - sizeof(uint64), wxT("Bad offset in CopyUInt64ToDataBuffer."));
+	PokeUInt64( pBuffer + offset, data );
+}
 // File_checked_for_headers
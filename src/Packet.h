@@ -41,7 +41,7 @@ class CPacket {
 public:
 	CPacket(CPacket &p);
 	CPacket(uint8 protocol);
-	CPacket(byte* header, byte *buf); // only used for receiving packets
+	CPacket(byte* header, byte *buf); // only used for receiving packets, buf must come from CPacketBufferPool
 	CPacket(const CMemFile& datafile, uint8 protocol, uint8 ucOpcode);
 	CPacket(int8 in_opcode, uint32 in_size, uint8 protocol, bool bFromPF = true);
 	CPacket(byte* pPacketPart, uint32 nSize, bool bLast, bool bFromPF = true); // only used for splitted packets!
@@ -70,6 +70,7 @@ public:
 	void			Copy16ToDataBuffer(const void* data);
 	void			CopyToDataBuffer(unsigned int offset, const byte* data, unsigned int n);
 	void			CopyUInt32ToDataBuffer(uint32 data, unsigned int offset = 0);
+	void			CopyUInt64ToDataBuffer(uint64 data, unsigned int offset = 0);
 
 private:
 	//! CPacket is not assignable.
@@ -82,6 +83,7 @@ private:
 	bool		m_bLastSplitted;
 	bool		m_bPacked;
 	bool		m_bFromPF;
+	bool		m_bPooledBuffer;
 	byte		head[6];
 	byte*		tempbuffer;
 	byte*		completebuffer;
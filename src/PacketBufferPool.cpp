@@ -0,0 +1,166 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "PacketBufferPool.h"	// Interface declarations
+
+#include <wx/thread.h>		// Needed for wxMutex
+
+#include <vector>
+
+
+// Buffer sizes handed out by the pool. Most control packets fit in the
+// smallest classes, file data comes in packets of a bit more than 10kB.
+static const uint32 s_classSizes[] = { 128, 512, 2048, 8192, 12288, 65536 };
+static const uint32 NUMBER_OF_CLASSES = sizeof(s_classSizes) / sizeof(s_classSizes[0]);
+// Marks buffers that were too big for any class.
+static const uint32 NO_CLASS = NUMBER_OF_CLASSES;
+
+// Upper bound of the memory kept in the free list of one class.
+static const uint32 MAX_BYTES_PER_CLASS = 1024 * 1024;
+
+// Every buffer is preceded by the index of its class. The prefix is 8 bytes
+// to keep the payload aligned for any type.
+static const uint32 PREFIX_SIZE = 8;
+
+
+static wxMutex			s_mutex;
+static std::vector<byte*>	s_freeLists[NUMBER_OF_CLASSES];
+static uint64			s_hits = 0;
+static uint64			s_misses = 0;
+static uint64			s_bytesHeld = 0;
+
+
+static uint32 GetClassForSize(uint32 size)
+{
+	for (uint32 i = 0; i < NUMBER_OF_CLASSES; ++i) {
+		if (size <= s_classSizes[i]) {
+			return i;
+		}
+	}
+
+	return NO_CLASS;
+}
+
+
+static uint32 GetMaxBuffersForClass(uint32 classIndex)
+{
+	return MAX_BYTES_PER_CLASS / s_classSizes[classIndex];
+}
+
+
+byte* CPacketBufferPool::Allocate(uint32 size)
+{
+	uint32 classIndex = GetClassForSize(size);
+	byte* block = NULL;
+
+	if (classIndex != NO_CLASS) {
+		wxMutexLocker lock(s_mutex);
+
+		std::vector<byte*>& freeList = s_freeLists[classIndex];
+		if (!freeList.empty()) {
+			block = freeList.back();
+			freeList.pop_back();
+			s_bytesHeld -= s_classSizes[classIndex];
+			++s_hits;
+
+			return block + PREFIX_SIZE;
+		}
+
+		++s_misses;
+		size = s_classSizes[classIndex];
+	} else {
+		wxMutexLocker lock(s_mutex);
+		++s_misses;
+	}
+
+	block = new byte[size + PREFIX_SIZE];
+	*reinterpret_cast<uint32*>(block) = classIndex;
+
+	return block + PREFIX_SIZE;
+}
+
+
+void CPacketBufferPool::Release(byte* buffer)
+{
+	if (buffer == NULL) {
+		return;
+	}
+
+	byte* block = buffer - PREFIX_SIZE;
+	uint32 classIndex = *reinterpret_cast<uint32*>(block);
+
+	if (classIndex < NUMBER_OF_CLASSES) {
+		wxMutexLocker lock(s_mutex);
+
+		std::vector<byte*>& freeList = s_freeLists[classIndex];
+		if (freeList.size() < GetMaxBuffersForClass(classIndex)) {
+			freeList.push_back(block);
+			s_bytesHeld += s_classSizes[classIndex];
+
+			return;
+		}
+	} else {
+		wxASSERT(classIndex == NO_CLASS);
+	}
+
+	delete [] block;
+}
+
+
+void CPacketBufferPool::Clear()
+{
+	wxMutexLocker lock(s_mutex);
+
+	for (uint32 i = 0; i < NUMBER_OF_CLASSES; ++i) {
+		std::vector<byte*>& freeList = s_freeLists[i];
+		for (std::vector<byte*>::iterator it = freeList.begin(); it != freeList.end(); ++it) {
+			delete [] *it;
+		}
+		freeList.clear();
+	}
+
+	s_bytesHeld = 0;
+}
+
+
+uint64 CPacketBufferPool::GetHits()
+{
+	wxMutexLocker lock(s_mutex);
+	return s_hits;
+}
+
+
+uint64 CPacketBufferPool::GetMisses()
+{
+	wxMutexLocker lock(s_mutex);
+	return s_misses;
+}
+
+
+uint64 CPacketBufferPool::GetBytesHeld()
+{
+	wxMutexLocker lock(s_mutex);
+	return s_bytesHeld;
+}
+// File_checked_for_headers
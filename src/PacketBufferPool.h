@@ -0,0 +1,71 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2003-2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef PACKETBUFFERPOOL_H
+#define PACKETBUFFERPOOL_H
+
+#include "Types.h"		// Needed for byte, uint32 and uint64
+
+
+/**
+ * Recycles the payload buffers of received packets.
+ *
+ * Buffers are kept in a handful of size classes. A released buffer goes back
+ * to the free list of its class (up to a limit per class), and is handed out
+ * again to the next packet of that class, so receiving does not go through
+ * the allocator for every packet. Buffers bigger than the largest class are
+ * allocated and freed normally.
+ *
+ * All functions are thread-safe.
+ */
+class CPacketBufferPool
+{
+public:
+	/**
+	 * Returns a buffer that can hold at least the given amount of bytes.
+	 * The buffer must be freed with Release(), never with delete[].
+	 */
+	static byte*	Allocate(uint32 size);
+
+	/**
+	 * Gives a buffer obtained from Allocate() back to the pool.
+	 * Passing NULL is allowed and does nothing.
+	 */
+	static void	Release(byte* buffer);
+
+	/**
+	 * Frees all buffers currently held by the pool.
+	 */
+	static void	Clear();
+
+	//! Number of allocations served from the free lists.
+	static uint64	GetHits();
+	//! Number of allocations that had to go to the allocator.
+	static uint64	GetMisses();
+	//! Memory held in the free lists, in bytes.
+	static uint64	GetBytesHeld();
+};
+
+#endif // PACKETBUFFERPOOL_H
+// File_checked_for_headers
@@ -36,6 +36,7 @@
 #include <protocol/Protocols.h>
 #include <common/DataFileVersion.h>
 #include <common/Constants.h>
+#include <common/Macros.h>
 #include <tags/FileTags.h>
 
 #include <wx/utils.h>
@@ -137,12 +138,22 @@ typedef std::list<Chunk> ChunkList;
 
 #ifndef CLIENT_GUI
 
+//! The source checks are done by the full pass of Process(), once per second
+#define SOURCE_CHECK_RESOLUTION	SEC2MS(1)
+//! How often sources that wait for something else than a time are checked
+#define SOURCE_RECHECK_TIME	SEC2MS(5)
+//! The most sources checked per file and pass, the others wait for the next pass
+#define MAX_SOURCE_CHECKS	100
+
+
 CPartFile::CPartFile()
+	: m_sourceCheckWheel(SOURCE_CHECK_RESOLUTION, ::GetTickCount())
 {
 	Init();
 }
 
 CPartFile::CPartFile(CSearchFile* searchresult)
+	: m_sourceCheckWheel(SOURCE_CHECK_RESOLUTION, ::GetTickCount())
 {
 	Init();
 
@@ -235,6 +246,7 @@ CPartFile::CPartFile(CSearchFile* searchresult)
 
 
 CPartFile::CPartFile(const CED2KFileLink* fileLink)
+	: m_sourceCheckWheel(SOURCE_CHECK_RESOLUTION, ::GetTickCount())
 {
 	Init();
 
@@ -1359,7 +1371,7 @@ void CPartFile::WriteCompleteSourcesCount(CMemFile* file)
 	file->WriteUInt16(m_nCompleteSourcesCount);
 }
 
-uint32 CPartFile::Process(uint32 reducedownload/*in percent*/,uint8 m_icounter)
+uint32 CPartFile::Process(uint8 m_icounter)
 {
 	uint16 old_trans;
 	uint32 dwCurTick = ::GetTickCount();
@@ -1376,114 +1388,18 @@ uint32 CPartFile::Process(uint32 reducedownload/*in percent*/,uint8 m_icounter)
 	transferingsrc = 0;
 	kBpsDown = 0.0;
 
-	if (m_icounter < 10) {
-		// Update only downloading sources.
-		CClientRefList::iterator it = m_downloadingSourcesList.begin();
-		for( ; it != m_downloadingSourcesList.end(); ) {
-			CUpDownClient *cur_src = it++->GetClient();
-			if(cur_src->GetDownloadState() == DS_DOWNLOADING) {
-				++transferingsrc;
-				kBpsDown += cur_src->SetDownloadLimit(reducedownload);
-			}
+	// Update downloading sources.
+	for (CClientRefList::iterator it = m_downloadingSourcesList.begin(); it != m_downloadingSourcesList.end(); ) {
+		CUpDownClient *cur_src = it++->GetClient();
+		if(cur_src->GetDownloadState() == DS_DOWNLOADING) {
+			++transferingsrc;
+			kBpsDown += cur_src->SetDownloadPriority(m_iDownPriority);
 		}
-	} else {
-		// Update all sources (including downloading sources)
-		for ( SourceSet::iterator it = m_SrcList.begin(); it != m_SrcList.end(); ) {
-			CUpDownClient* cur_src = it++->GetClient();
-			switch (cur_src->GetDownloadState()) {
-				case DS_DOWNLOADING: {
-					++transferingsrc;
-					kBpsDown += cur_src->SetDownloadLimit(reducedownload);
-					break;
-				}
-				case DS_BANNED: {
-					break;
-				}
-				case DS_ERROR: {
-					break;
-				}
-				case DS_LOWTOLOWIP: {
-					if (cur_src->HasLowID() && !theApp->CanDoCallback(cur_src->GetServerIP(), cur_src->GetServerPort())) {
-						// If we are almost maxed on sources,
-						// slowly remove these client to see
-						// if we can find a better source.
-						if (((dwCurTick - lastpurgetime) > 30000) &&
-							(GetSourceCount() >= (thePrefs::GetMaxSourcePerFile()*.8))) {
-							RemoveSource(cur_src);
-							lastpurgetime = dwCurTick;
-							break;
-						}
-					} else {
-						cur_src->SetDownloadState(DS_ONQUEUE);
-					}
-
-					break;
-				}
-				case DS_NONEEDEDPARTS: {
-					// we try to purge noneeded source, even without reaching the limit
-					if((dwCurTick - lastpurgetime) > 40000) {
-						if(!cur_src->SwapToAnotherFile(false , false, false , NULL)) {
-							//however we only delete them if reaching the limit
-							if (GetSourceCount() >= (thePrefs::GetMaxSourcePerFile()*.8 )) {
-								RemoveSource(cur_src);
-								lastpurgetime = dwCurTick;
-								break; //Johnny-B - nothing more to do here (good eye!)
-							}
-						} else {
-							lastpurgetime = dwCurTick;
-							break;
-						}
-					}
-					// doubled reasktime for no needed parts - save connections and traffic
-					if (	!((!cur_src->GetLastAskedTime()) ||
-						 (dwCurTick - cur_src->GetLastAskedTime()) > FILEREASKTIME*2)) {
-						break;
-					}
-					// Recheck this client to see if still NNP..
-					// Set to DS_NONE so that we force a TCP reask next time..
-					cur_src->SetDownloadState(DS_NONE);
-
-					break;
-				}
-				case DS_ONQUEUE: {
-					if( cur_src->IsRemoteQueueFull()) {
-						if(	((dwCurTick - lastpurgetime) > 60000) &&
-							(GetSourceCount() >= (thePrefs::GetMaxSourcePerFile()*.8 )) ) {
-							RemoveSource( cur_src );
-							lastpurgetime = dwCurTick;
-							break; //Johnny-B - nothing more to do here (good eye!)
-						}
-					}
-
-					// Give up to 1 min for UDP to respond..
-					// If we are within on min on TCP, do not try..
-					if (	theApp->IsConnected() &&
-						(	(!cur_src->GetLastAskedTime()) ||
-							(dwCurTick - cur_src->GetLastAskedTime()) > FILEREASKTIME-20000)) {
-						cur_src->UDPReaskForDownload();
-					}
+	}
 
-					// No break here, since the next case takes care of asking for downloads.
-				}
-				/* fall through */
-				case DS_CONNECTING:
-				case DS_TOOMANYCONNS:
-				case DS_NONE:
-				case DS_WAITCALLBACK:
-				case DS_WAITCALLBACKKAD:	{
-					if (	theApp->IsConnected() &&
-						(	(!cur_src->GetLastAskedTime()) ||
-							(dwCurTick - cur_src->GetLastAskedTime()) > FILEREASKTIME)) {
-						if (!cur_src->AskForDownload()) {
-							// I left this break here just as a reminder
-							// just in case re rearange things..
-							break;
-						}
-					}
-					break;
-				}
-			}
-		}
+	if (m_icounter >= 10) {
+		// Update the other sources, those that are due
+		theStats::AddSourceChecks(ProcessSourceChecks(dwCurTick));
 
 		/* eMule 0.30c implementation, i give it a try (Creteil) BEGIN ... */
 		if (IsA4AFAuto() && ((!m_LastNoNeededCheck) || (dwCurTick - m_LastNoNeededCheck > 900000))) {
@@ -3491,6 +3407,7 @@ bool CPartFile::AddSource( CUpDownClient* client )
 	if (m_SrcList.insert(CCLIENTREF(client, wxT("CPartFile::AddSource"))).second) {
 		theStats::AddFoundSource();
 		theStats::AddSourceOrigin(client->GetSourceFrom());
+		ScheduleSourceCheck(client, ::GetTickCount());
 		return true;
 	} else {
 		return false;
@@ -3503,6 +3420,8 @@ bool CPartFile::DelSource( CUpDownClient* client )
 	if (m_SrcList.erase(CCLIENTREF(client, wxEmptyString))) {
 		theStats::RemoveSourceOrigin(client->GetSourceFrom());
 		theStats::RemoveFoundSource();
+		// Its checks still in the wheel are skipped when due
+		m_sourceChecks.erase(client);
 		return true;
 	} else {
 		return false;
@@ -3510,6 +3429,208 @@ bool CPartFile::DelSource( CUpDownClient* client )
 }
 
 
+void CPartFile::ScheduleSourceCheck( CUpDownClient* client, uint32 when )
+{
+	// Sources are only tracked while listed, so the pointers in the wheel stay valid
+	if (m_SrcList.find(CCLIENTREF(client, wxEmptyString)) == m_SrcList.end()) {
+		return;
+	}
+
+	SourceCheckMap::iterator it = m_sourceChecks.find(client);
+	if (it == m_sourceChecks.end()) {
+		m_sourceChecks.insert(SourceCheckMap::value_type(client, when));
+	} else if ((sint32)(when - it->second) < 0) {
+		it->second = when;
+	} else {
+		return;
+	}
+
+	m_sourceCheckWheel.Add(SourceCheck(client, when), when);
+}
+
+
+uint32 CPartFile::ProcessSourceChecks(uint32 dwCurTick)
+{
+	// The checks left over from the last pass come first
+	std::vector<SourceCheck> due;
+	due.swap(m_deferredSourceChecks);
+	m_sourceCheckWheel.Expire(dwCurTick, due);
+
+	uint32 checks = 0;
+	for (std::vector<SourceCheck>::iterator it = due.begin(); it != due.end(); ++it) {
+		SourceCheckMap::iterator itCheck = m_sourceChecks.find(it->first);
+		if (itCheck == m_sourceChecks.end() || itCheck->second != it->second) {
+			// The source was removed or rescheduled since
+			continue;
+		}
+
+		if (checks >= MAX_SOURCE_CHECKS) {
+			// Keep the time spent per pass bounded, the rest goes first next time
+			m_deferredSourceChecks.push_back(*it);
+			continue;
+		}
+
+		m_sourceChecks.erase(itCheck);
+		++checks;
+
+		// Keeps the client around if the check removes it
+		CClientRef source(CCLIENTREF(it->first, wxT("CPartFile::ProcessSourceChecks")));
+		CheckSource(it->first, dwCurTick);
+
+		CUpDownClient* cur_src = source.GetClientChecked();
+		uint32 next;
+		if (cur_src && GetNextSourceCheck(cur_src, dwCurTick, next)) {
+			ScheduleSourceCheck(cur_src, next);
+		}
+	}
+
+	return checks;
+}
+
+
+void CPartFile::CheckSource(CUpDownClient* cur_src, uint32 dwCurTick)
+{
+	switch (cur_src->GetDownloadState()) {
+		case DS_BANNED: {
+			break;
+		}
+		case DS_ERROR: {
+			break;
+		}
+		case DS_LOWTOLOWIP: {
+			if (cur_src->HasLowID() && !theApp->CanDoCallback(cur_src->GetServerIP(), cur_src->GetServerPort())) {
+				// If we are almost maxed on sources,
+				// slowly remove these client to see
+				// if we can find a better source.
+				if (((dwCurTick - lastpurgetime) > 30000) &&
+					(GetSourceCount() >= (thePrefs::GetMaxSourcePerFile()*.8))) {
+					RemoveSource(cur_src);
+					lastpurgetime = dwCurTick;
+					break;
+				}
+			} else {
+				cur_src->SetDownloadState(DS_ONQUEUE);
+			}
+
+			break;
+		}
+		case DS_NONEEDEDPARTS: {
+			// we try to purge noneeded source, even without reaching the limit
+			if((dwCurTick - lastpurgetime) > 40000) {
+				if(!cur_src->SwapToAnotherFile(false , false, false , NULL)) {
+					//however we only delete them if reaching the limit
+					if (GetSourceCount() >= (thePrefs::GetMaxSourcePerFile()*.8 )) {
+						RemoveSource(cur_src);
+						lastpurgetime = dwCurTick;
+						break; //Johnny-B - nothing more to do here (good eye!)
+					}
+				} else {
+					lastpurgetime = dwCurTick;
+					break;
+				}
+			}
+			// doubled reasktime for no needed parts - save connections and traffic
+			if (	!((!cur_src->GetLastAskedTime()) ||
+				 (dwCurTick - cur_src->GetLastAskedTime()) > FILEREASKTIME*2)) {
+				break;
+			}
+			// Recheck this client to see if still NNP..
+			// Set to DS_NONE so that we force a TCP reask next time..
+			cur_src->SetDownloadState(DS_NONE);
+
+			break;
+		}
+		case DS_ONQUEUE: {
+			if( cur_src->IsRemoteQueueFull()) {
+				if(	((dwCurTick - lastpurgetime) > 60000) &&
+					(GetSourceCount() >= (thePrefs::GetMaxSourcePerFile()*.8 )) ) {
+					RemoveSource( cur_src );
+					lastpurgetime = dwCurTick;
+					break; //Johnny-B - nothing more to do here (good eye!)
+				}
+			}
+
+			// Give up to 1 min for UDP to respond..
+			// If we are within on min on TCP, do not try..
+			if (	theApp->IsConnected() &&
+				(	(!cur_src->GetLastAskedTime()) ||
+					(dwCurTick - cur_src->GetLastAskedTime()) > FILEREASKTIME-20000)) {
+				cur_src->UDPReaskForDownload();
+			}
+
+			// No break here, since the next case takes care of asking for downloads.
+		}
+		/* fall through */
+		case DS_CONNECTING:
+		case DS_TOOMANYCONNS:
+		case DS_NONE:
+		case DS_WAITCALLBACK:
+		case DS_WAITCALLBACKKAD:	{
+			if (	theApp->IsConnected() &&
+				(	(!cur_src->GetLastAskedTime()) ||
+					(dwCurTick - cur_src->GetLastAskedTime()) > FILEREASKTIME)) {
+				if (!cur_src->AskForDownload()) {
+					// I left this break here just as a reminder
+					// just in case re rearange things..
+					break;
+				}
+			}
+			break;
+		}
+	}
+}
+
+
+bool CPartFile::GetNextSourceCheck(const CUpDownClient* client, uint32 dwCurTick, uint32& when) const
+{
+	uint32 lastAsked = client->GetLastAskedTime();
+
+	switch (client->GetDownloadState()) {
+		case DS_DOWNLOADING:
+		case DS_BANNED:
+		case DS_ERROR:
+			// Nothing to do until the state changes
+			return false;
+
+		case DS_LOWTOLOWIP:
+			// Waiting for a callback to become possible
+			when = dwCurTick + SOURCE_RECHECK_TIME;
+			return true;
+
+		case DS_NONEEDEDPARTS:
+			// Purging is retried after 40 seconds, reasking after the doubled reask time
+			when = lastAsked + FILEREASKTIME * 2;
+			if (!lastAsked || (sint32)(when - (dwCurTick + 40000)) > 0) {
+				when = dwCurTick + 40000;
+			}
+			break;
+
+		case DS_ONQUEUE:
+			// The UDP reask comes 20 seconds before the TCP one
+			when = lastAsked + FILEREASKTIME - 20000;
+			if ((sint32)(when - dwCurTick) <= 0) {
+				when = lastAsked + FILEREASKTIME;
+			}
+			// Sources with a full queue are considered for purging every minute
+			if (client->IsRemoteQueueFull() && (sint32)(when - (dwCurTick + 60000)) > 0) {
+				when = dwCurTick + 60000;
+			}
+			break;
+
+		default:
+			when = lastAsked + FILEREASKTIME;
+			break;
+	}
+
+	// Whatever was due didn't happen, such as asking while not connected
+	if (!lastAsked || (sint32)(when - dwCurTick) <= 0) {
+		when = dwCurTick + SOURCE_RECHECK_TIME;
+	}
+
+	return true;
+}
+
+
 void CPartFile::UpdatePartsFrequency( CUpDownClient* client, bool increment )
 {
 	const BitVector& freq = client->GetPartStatus();
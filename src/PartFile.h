@@ -32,6 +32,7 @@
 
 #include "OtherStructs.h"	// Needed for Requested_Block_Struct
 #include "DeadSourceList.h"	// Needed for CDeadSourceList
+#include "TimerWheel.h"		// Needed for CTimerWheel
 #include "GapList.h"
 
 class CSearchFile;
@@ -108,7 +109,7 @@ public:
 	bool	IsCompleted() const		{ return status == PS_COMPLETE; }	// true if completed
 	bool	IsCPartFile() const		{ return true; }					// true if it's a CPartFile
 
-	uint32	Process(uint32 reducedownload, uint8 m_icounter);
+	uint32	Process(uint8 m_icounter);
 	uint8	LoadPartFile(const CPath& in_directory, const CPath& filename, bool from_backup = false, bool getsizeonly = false);
 	bool	SavePartFile(bool Initial = false);
 	void	PartFileHashFinished(CKnownFile* result);
@@ -228,6 +229,20 @@ public:
 	 */
 	void	ClientStateChanged( int oldState, int newState );
 
+#ifndef CLIENT_GUI
+	/**
+	 * Makes Process() look at a source of this file once 'when' has passed.
+	 *
+	 * @param client The source, which must be in the source list.
+	 * @param when The GetTickCount() at which the source should be checked.
+	 *
+	 * Sources are not visited on every pass, only when one of their re-ask
+	 * times has come, or when their state has changed. An earlier check that
+	 * is already scheduled is kept, since the check schedules the next one.
+	 */
+	void	ScheduleSourceCheck( CUpDownClient* client, uint32 when );
+#endif
+
 	bool	AddSource( CUpDownClient* client );
 	bool	DelSource( CUpDownClient* client );
 
@@ -294,6 +309,22 @@ private:
 	CDeadSourceList	m_deadSources;
 
 	class CCorruptionBlackBox* m_CorruptionBlackBox;
+
+	//! Checks the sources that are due, returns the number checked.
+	uint32	ProcessSourceChecks(uint32 dwCurTick);
+	//! Does whatever is due for a source in its current state.
+	void	CheckSource(CUpDownClient* cur_src, uint32 dwCurTick);
+	//! Returns false if nothing is due for the source until its state changes.
+	bool	GetNextSourceCheck(const CUpDownClient* client, uint32 dwCurTick, uint32& when) const;
+
+	typedef std::pair<CUpDownClient*, uint32> SourceCheck;
+	typedef std::map<CUpDownClient*, uint32> SourceCheckMap;
+	//! The time of the next check of each source, checks not listed here are stale.
+	SourceCheckMap	m_sourceChecks;
+	//! The scheduled checks, by time.
+	CTimerWheel<SourceCheck> m_sourceCheckWheel;
+	//! The due checks that didn't fit in the last pass, in order.
+	std::vector<SourceCheck> m_deferredSourceChecks;
 #endif
 
 	uint16	m_notCurrentSources;
@@ -90,14 +90,18 @@ void CRC4EncryptableBuffer::RC4Crypt( const uint8 *pachIn, uint8 *pachOut, uint3
 	}
 }
 
-uint8 *CRC4EncryptableBuffer::Detach()
+void CRC4EncryptableBuffer::DiscardFront(uint32 n)
 {
-	int n = GetLength();
-	uint8 *ret = new uint8[n];
-	memcpy(ret, GetRawBuffer(), n);
-	ResetData();
-	m_encrypted = false;
-	return ret;
+	uint32 length = GetLength();
+	wxASSERT(n <= length);
+
+	if (n >= length) {
+		ResetData();
+	} else if (n > 0) {
+		memmove(GetRawBuffer(), GetRawBuffer() + n, length - n);
+		SetLength(length - n);
+		Seek(length - n, wxFromStart);
+	}
 }
 
 
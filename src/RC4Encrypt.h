@@ -69,8 +69,8 @@ public:
 	// RC4 encrypts an external buffer with the current key.
 	void RC4Crypt(const uint8 *pachIn, uint8 *pachOut, uint32 nLen);
 
-	// Returns a uint8* buffer with a copy of the internal data, and clears the internal one.
-	uint8* Detach();
+	// Removes the first n bytes, keeping the rest of the data in place.
+	void DiscardFront(uint32 n);
 
 	// Also clears the encryption flag
 	void ResetData();
@@ -194,7 +194,7 @@ void CServerListCtrl::RefreshServer( CServer* server )
 #ifdef ENABLE_IP2COUNTRY
 	// Get the country name
 	if (theApp->amuledlg->m_IP2Country->IsEnabled() && thePrefs::IsGeoIPEnabled()) {
-		const CountryData& countrydata = theApp->amuledlg->m_IP2Country->GetCountryData(server->GetFullIP());
+		const CountryData& countrydata = theApp->amuledlg->m_IP2Country->GetCountryData(server->GetIP());
 		serverName << countrydata.Name;
 		serverName << wxT(" - ");
 	}
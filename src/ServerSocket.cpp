@@ -644,15 +644,7 @@ void CServerSocket::ConnectToServer(CServer* server, bool bNoCrypt)
 	if (cur_server->HasDynIP() || !cur_server->GetIP()) {
 		m_IsSolving = true;
 		// Send it to solving thread.
-		CAsyncDNS* dns = new CAsyncDNS(server->GetAddress(), DNS_SERVER_CONNECT, theApp, this);
-
-		if ( dns->Create() == wxTHREAD_NO_ERROR ) {
-			if ( dns->Run() != wxTHREAD_NO_ERROR ) {
-				dns->Delete();
-				AddLogLineN(CFormat( _("Cannot create DNS solving thread for connecting to %s") ) % cur_server->GetAddress());
-			}
-		} else {
-			dns->Delete();
+		if (!CAsyncDNS::Resolve(server->GetAddress(), DNS_SERVER_CONNECT, theApp, this)) {
 			AddLogLineN(CFormat( _("Cannot create DNS solving thread for connecting to %s") ) % cur_server->GetAddress());
 		}
 	} else {
@@ -415,8 +415,7 @@ void CServerUDPSocket::SendQueue()
 			if (update) {
 				if (update->GetLastDNSSolve() + DNS_SOLVE_TIME < ::GetTickCount64()) {
 					// Its time for a new check.
-					CAsyncDNS* dns = new CAsyncDNS(item.addr, DNS_UDP, theApp, this);
-					if ((dns->Create() != wxTHREAD_NO_ERROR) || (dns->Run() != wxTHREAD_NO_ERROR)) {
+					if (!CAsyncDNS::Resolve(item.addr, DNS_UDP, theApp, this)) {
 						// Not much we can do here, just drop the packet.
 						m_queue.pop_front();
 						continue;
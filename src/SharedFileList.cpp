@@ -764,6 +764,9 @@ void CSharedFileList::Process()
 	m_lastPublishED2K = ::GetTickCount();
 }
 
+// Number of files or keywords Publish() looks at per turn to find one that is due.
+static const unsigned PUBLISH_SCAN_LIMIT = 100;
+
 void CSharedFileList::Publish()
 {
 	// Variables to save cpu.
@@ -780,8 +783,15 @@ void CSharedFileList::Publish()
 
 				//Enough time has passed since last keyword publish
 
-				//Get the next keyword which has to be (re)-published
-				CPublishKeyword* pPubKw = m_keywords->GetNextKeyword();
+				//Get the next keyword which has to be (re)-published. Keywords that are
+				//not due yet are skipped right away, so they don't use up a publish turn.
+				CPublishKeyword* pPubKw = NULL;
+				for (unsigned scanned = 0; scanned < PUBLISH_SCAN_LIMIT; ++scanned) {
+					pPubKw = m_keywords->GetNextKeyword();
+					if (pPubKw == NULL || tNow >= pPubKw->GetNextPublishTime()) {
+						break;
+					}
+				}
 				if (pPubKw) {
 
 					//We have the next keyword to check if it can be published
@@ -835,20 +845,22 @@ void CSharedFileList::Publish()
 
 		if( Kademlia::CKademlia::GetTotalStoreSrc() < KADEMLIATOTALSTORESRC) {
 			if(tNow >= m_lastPublishKadSrc) {
-				if(m_currFileSrc > GetCount()) {
-					m_currFileSrc = 0;
-				}
-				CKnownFile* pCurKnownFile = const_cast<CKnownFile*>(GetFileByIndex(m_currFileSrc));
-				if(pCurKnownFile) {
-					if(pCurKnownFile->PublishSrc()) {
+				// Skip the files that don't need to be published yet, up to the first one that does
+				for (unsigned scanned = 0; scanned < PUBLISH_SCAN_LIMIT; ++scanned) {
+					if(m_currFileSrc > GetCount()) {
+						m_currFileSrc = 0;
+					}
+					CKnownFile* pCurKnownFile = const_cast<CKnownFile*>(GetFileByIndex(m_currFileSrc));
+					m_currFileSrc++;
+					if(pCurKnownFile && pCurKnownFile->PublishSrc()) {
 						Kademlia::CUInt128 kadFileID;
 						kadFileID.SetValueBE(pCurKnownFile->GetFileHash().GetHash());
 						if(Kademlia::CSearchManager::PrepareLookup(Kademlia::CSearch::STOREFILE, true, kadFileID )==NULL) {
 							pCurKnownFile->SetLastPublishTimeKadSrc(0,0);
 						}
+						break;
 					}
 				}
-				m_currFileSrc++;
 
 				// even if we did not publish a source, reset the timer so that this list is processed
 				// only every KADEMLIAPUBLISHTIME seconds.
@@ -858,19 +870,21 @@ void CSharedFileList::Publish()
 
 		if( Kademlia::CKademlia::GetTotalStoreNotes() < KADEMLIATOTALSTORENOTES) {
 			if(tNow >= m_lastPublishKadNotes) {
-				if(m_currFileNotes > GetCount()) {
-					m_currFileNotes = 0;
-				}
-				CKnownFile* pCurKnownFile = const_cast<CKnownFile*>(GetFileByIndex(m_currFileNotes));
-				if(pCurKnownFile) {
-					if(pCurKnownFile->PublishNotes()) {
+				// Skip the files that don't need to be published yet, up to the first one that does
+				for (unsigned scanned = 0; scanned < PUBLISH_SCAN_LIMIT; ++scanned) {
+					if(m_currFileNotes > GetCount()) {
+						m_currFileNotes = 0;
+					}
+					CKnownFile* pCurKnownFile = const_cast<CKnownFile*>(GetFileByIndex(m_currFileNotes));
+					m_currFileNotes++;
+					if(pCurKnownFile && pCurKnownFile->PublishNotes()) {
 						Kademlia::CUInt128 kadFileID;
 						kadFileID.SetValueBE(pCurKnownFile->GetFileHash().GetHash());
 						if(Kademlia::CSearchManager::PrepareLookup(Kademlia::CSearch::STORENOTES, true, kadFileID )==NULL)
 							pCurKnownFile->SetLastPublishTimeKadNotes(0);
+						break;
 					}
 				}
-				m_currFileNotes++;
 
 				// even if we did not publish a source, reset the timer so that this list is processed
 				// only every KADEMLIAPUBLISHTIME seconds.
@@ -40,6 +40,11 @@
 	#include "DataToText.h"		// Needed for GetSoftName()
 	#include "ListenSocket.h"	// (tree, GetAverageConnections)
 	#include "ServerList.h"		// Needed for CServerList (tree)
+	#include "PacketBufferPool.h"	// Needed for CPacketBufferPool (tree)
+	#include "MuleUDPSocket.h"	// Needed for CMuleUDPSocket (tree)
+	#include "AsyncDNS.h"		// Needed for CAsyncDNS (tree)
+	#include "kademlia/kademlia/SearchManager.h"	// Needed for CSearchManager (tree)
+	#include "kademlia/net/KadPacketStats.h"	// Needed for CKadPacketStats (tree)
 	#include <cmath>		// Needed for std::floor
 	#include "updownclient.h"	// Needed for CUpDownClient
 #else
@@ -181,6 +186,8 @@ CStatTreeItemPackets*		CStatistics::s_kadDownOverhead;
 CStatTreeItemCounter*		CStatistics::s_cryptDownOverhead;
 CStatTreeItemCounter*		CStatistics::s_foundSources;
 CStatTreeItemNativeCounter*	CStatistics::s_activeDownloads;
+CStatTreeItemCounter*		CStatistics::s_sourceChecks;
+CStatTreeItemCounter*		CStatistics::s_sourceCheckPasses;
 
 // Connection
 CStatTreeItemReconnects*	CStatistics::s_reconnects;
@@ -189,6 +196,30 @@ CStatTreeItemTimer*		CStatistics::s_sinceConnected;
 CStatTreeItemCounterMax*	CStatistics::s_activeConnections;
 CStatTreeItemMaxConnLimitReached* CStatistics::s_limitReached;
 CStatTreeItemSimple*		CStatistics::s_avgConnections;
+CStatTreeItemSimple*		CStatistics::s_packetPoolHits;
+CStatTreeItemSimple*		CStatistics::s_packetPoolMisses;
+CStatTreeItemSimple*		CStatistics::s_packetPoolHeld;
+CStatTreeItemSimple*		CStatistics::s_udpReceiveBatch;
+CStatTreeItemSimple*		CStatistics::s_udpSendBatch;
+CStatTreeItemSimple*		CStatistics::s_dnsLookups;
+CStatTreeItemSimple*		CStatistics::s_dnsCacheHits;
+CStatTreeItemSimple*		CStatistics::s_dnsMerged;
+CStatTreeItemSimple*		CStatistics::s_dnsFailures;
+CStatTreeItemSimple*		CStatistics::s_dnsLatency;
+CStatTreeItemSimple*		CStatistics::s_kadRequestTimeout;
+CStatTreeItemSimple*		CStatistics::s_kadExpiredRequests;
+CStatTreeItemSimple*		CStatistics::s_kadResponseRate;
+CStatTreeItemSimple*		CStatistics::s_kadParallelism;
+CStatTreeItemSimple*		CStatistics::s_kadFirstResultMedian;
+CStatTreeItemSimple*		CStatistics::s_kadFirstResult90;
+CStatTreeItemSimple*		CStatistics::s_kadConvergedMedian;
+CStatTreeItemSimple*		CStatistics::s_kadConverged90;
+CStatTreeItemBase*		CStatistics::s_kadPackets;
+CStatTreeItemSimple*		CStatistics::s_kadPacketsDropped;
+CStatTreeItemSimple*		CStatistics::s_kadOpcodes[256];
+CStatTreeItemSimple*		CStatistics::s_rejectedFiltered;
+CStatTreeItemSimple*		CStatistics::s_rejectedBanned;
+CStatTreeItemSimple*		CStatistics::s_rejectedFlooding;
 
 // Clients
 CStatTreeItemHiddenCounter*	CStatistics::s_clients;
@@ -279,6 +310,7 @@ CStatistics::~CStatistics()
 
 	// delete items not in the tree
 	delete s_totalUploadTime;
+	delete s_sourceCheckPasses;
 
 	// delete rate counters outside the tree
 	delete s_upOverheadRate;
@@ -770,6 +802,9 @@ void CStatistics::InitStatsTree()
 	s_cryptDownOverhead->SetDisplayMode(dmBytes);
 	s_foundSources = static_cast<CStatTreeItemCounter*>(tmpRoot2->AddChild(new CStatTreeItemCounter(wxTRANSLATE("Found Sources: %s"), stSortChildren | stSortByValue)));
 	s_activeDownloads = static_cast<CStatTreeItemNativeCounter*>(tmpRoot2->AddChild(new CStatTreeItemNativeCounter(wxTRANSLATE("Active Downloads (chunks): %s"))));
+	s_sourceChecks = static_cast<CStatTreeItemCounter*>(tmpRoot2->AddChild(new CStatTreeItemCounter(wxTRANSLATE("Source checks: %s"))));
+	s_sourceCheckPasses = new CStatTreeItemCounter(wxEmptyString);
+	tmpRoot2->AddChild(new CStatTreeItemAverage(wxTRANSLATE("Average source checks per file and pass: %s"), s_sourceChecks, s_sourceCheckPasses, dmDefault));
 
 	tmpRoot1->AddChild(new CStatTreeItemRatio(wxTRANSLATE("Session UL:DL Ratio (Total): %s"), s_sessionUpload, s_sessionDownload, theStats::GetTotalSentBytes, theStats::GetTotalReceivedBytes), 3);
 
@@ -786,6 +821,38 @@ void CStatistics::InitStatsTree()
 	s_avgConnections = static_cast<CStatTreeItemSimple*>(tmpRoot1->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Average Connections (estimate): %g"))));
 	s_avgConnections->SetValue(0.0);
 	tmpRoot1->AddChild(new CStatTreeItemPeakConnections(wxTRANSLATE("Peak Connections (estimate): %i")));
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("Rejected incoming connections")));
+	s_rejectedFiltered = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Filtered IP: %llu"))));
+	s_rejectedBanned = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Banned client: %llu"))));
+	s_rejectedFlooding = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Too many connection attempts: %llu"))));
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("Packet buffer pool")));
+	s_packetPoolHits = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Reused buffers: %llu"))));
+	s_packetPoolMisses = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Allocated buffers: %llu"))));
+	s_packetPoolHeld = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Memory held: %s"), stNone, dmBytes)));
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("UDP batching")));
+	s_udpReceiveBatch = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Average datagrams per receive event: %g"))));
+	s_udpReceiveBatch->SetValue(0.0);
+	s_udpSendBatch = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Average datagrams per send call: %g"))));
+	s_udpSendBatch->SetValue(0.0);
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("DNS lookups")));
+	s_dnsLookups = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Lookups: %llu"))));
+	s_dnsCacheHits = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Answered from cache: %llu"))));
+	s_dnsMerged = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Merged with pending lookups: %llu"))));
+	s_dnsFailures = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Failed: %llu"))));
+	s_dnsLatency = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Average resolving time (ms): %g"))));
+	s_dnsLatency->SetValue(0.0);
+	tmpRoot2 = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("Kad lookups")));
+	s_kadRequestTimeout = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Request timeout (ms): %llu"))));
+	s_kadExpiredRequests = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Unanswered requests given up: %llu"))));
+	s_kadResponseRate = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Requests answered in time: %.1f%%"))));
+	s_kadParallelism = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Requests in flight per lookup: %llu"))));
+	s_kadFirstResultMedian = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Time to first result, median (ms): %llu"))));
+	s_kadFirstResult90 = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Time to first result, 90th percentile (ms): %llu"))));
+	s_kadConvergedMedian = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Time to converge, median (ms): %llu"))));
+	s_kadConverged90 = static_cast<CStatTreeItemSimple*>(tmpRoot2->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Time to converge, 90th percentile (ms): %llu"))));
+	// One item per opcode is added as soon as it is seen
+	s_kadPackets = tmpRoot1->AddChild(new CStatTreeItemBase(wxTRANSLATE("Kad packets")));
+	s_kadPacketsDropped = static_cast<CStatTreeItemSimple*>(s_kadPackets->AddChild(new CStatTreeItemSimple(wxTRANSLATE("Dropped by flood protection: %llu"))));
 
 	s_clients = static_cast<CStatTreeItemHiddenCounter*>(s_statTree->AddChild(new CStatTreeItemHiddenCounter(wxTRANSLATE("Clients"), stSortChildren | stSortByValue)));
 	s_unknown = static_cast<CStatTreeItemCounter*>(s_clients->AddChild(new CStatTreeItemCounter(wxTRANSLATE("Unknown: %s")), 6));
@@ -830,6 +897,43 @@ void CStatistics::UpdateStatsTree()
 	// TODO: sort OS_Info subtrees.
 
 	s_avgConnections->SetValue(theApp->listensocket->GetAverageConnections());
+	s_rejectedFiltered->SetValue(theApp->listensocket->GetRejectedFiltered());
+	s_rejectedBanned->SetValue(theApp->listensocket->GetRejectedBanned());
+	s_rejectedFlooding->SetValue(theApp->listensocket->GetRejectedFlooding());
+
+	s_packetPoolHits->SetValue(CPacketBufferPool::GetHits());
+	s_packetPoolMisses->SetValue(CPacketBufferPool::GetMisses());
+	s_packetPoolHeld->SetValue(CPacketBufferPool::GetBytesHeld());
+
+	s_udpReceiveBatch->SetValue(CMuleUDPSocket::GetAverageReceiveBatch());
+	s_udpSendBatch->SetValue(CMuleUDPSocket::GetAverageSendBatch());
+
+	s_dnsLookups->SetValue(CAsyncDNS::GetLookups());
+	s_dnsCacheHits->SetValue(CAsyncDNS::GetCacheHits());
+	s_dnsMerged->SetValue(CAsyncDNS::GetMergedLookups());
+	s_dnsFailures->SetValue(CAsyncDNS::GetFailures());
+	s_dnsLatency->SetValue(CAsyncDNS::GetAverageLatency());
+
+	s_kadRequestTimeout->SetValue((uint64_t)Kademlia::CSearchManager::GetRequestTimeout());
+	s_kadExpiredRequests->SetValue(Kademlia::CSearchManager::GetExpiredRequests());
+	s_kadResponseRate->SetValue(Kademlia::CSearchManager::GetResponseRate() / 10.0);
+	s_kadParallelism->SetValue((uint64_t)Kademlia::CSearchManager::GetParallelism());
+	s_kadFirstResultMedian->SetValue((uint64_t)Kademlia::CSearchManager::GetFirstResultPercentile(50));
+	s_kadFirstResult90->SetValue((uint64_t)Kademlia::CSearchManager::GetFirstResultPercentile(90));
+	s_kadConvergedMedian->SetValue((uint64_t)Kademlia::CSearchManager::GetConvergedPercentile(50));
+	s_kadConverged90->SetValue((uint64_t)Kademlia::CSearchManager::GetConvergedPercentile(90));
+
+	s_kadPacketsDropped->SetValue(Kademlia::CKadPacketStats::GetTotalDropped());
+	for (unsigned opcode = 0; opcode < 256; ++opcode) {
+		const Kademlia::CKadPacketStats::OpcodeStats& stats = Kademlia::CKadPacketStats::GetStats(opcode);
+		if (stats.packetsIn == 0 && stats.packetsOut == 0) {
+			continue;
+		}
+		if (s_kadOpcodes[opcode] == NULL) {
+			s_kadOpcodes[opcode] = static_cast<CStatTreeItemSimple*>(s_kadPackets->AddChild(new CStatTreeItemSimple(Kademlia::CKadPacketStats::GetOpcodeName(opcode) + wxT(": %s"))));
+		}
+		s_kadOpcodes[opcode]->SetValue(Kademlia::CKadPacketStats::GetSummary(opcode));
+	}
 
 	// get serverstats
 	// TODO: make these realtime, too
@@ -279,6 +279,7 @@ class CStatistics {
 	static	void	AddDownloadingSource()			{ ++(*s_activeDownloads); }
 	static	void	RemoveDownloadingSource()		{ --(*s_activeDownloads); }
 	static	uint32	GetDownloadingSources()			{ return (*s_activeDownloads); }
+	static	void	AddSourceChecks(uint32 count)		{ (*s_sourceChecks) += count; ++(*s_sourceCheckPasses); }
 	static	double	GetDownloadRate()			{ return s_downloadrate->GetRate(); }
 
 	// Connection
@@ -431,6 +432,8 @@ class CStatistics {
 	static	CStatTreeItemCounter*		s_cryptDownOverhead;
 	static	CStatTreeItemCounter*		s_foundSources;
 	static	CStatTreeItemNativeCounter*	s_activeDownloads;
+	static	CStatTreeItemCounter*		s_sourceChecks;
+	static	CStatTreeItemCounter*		s_sourceCheckPasses;
 
 	// Connection
 	static	CStatTreeItemReconnects*	s_reconnects;
@@ -439,6 +442,30 @@ class CStatistics {
 	static	CStatTreeItemCounterMax*	s_activeConnections;
 	static	CStatTreeItemMaxConnLimitReached* s_limitReached;
 	static	CStatTreeItemSimple*		s_avgConnections;
+	static	CStatTreeItemSimple*		s_packetPoolHits;
+	static	CStatTreeItemSimple*		s_packetPoolMisses;
+	static	CStatTreeItemSimple*		s_packetPoolHeld;
+	static	CStatTreeItemSimple*		s_udpReceiveBatch;
+	static	CStatTreeItemSimple*		s_udpSendBatch;
+	static	CStatTreeItemSimple*		s_dnsLookups;
+	static	CStatTreeItemSimple*		s_dnsCacheHits;
+	static	CStatTreeItemSimple*		s_dnsMerged;
+	static	CStatTreeItemSimple*		s_dnsFailures;
+	static	CStatTreeItemSimple*		s_dnsLatency;
+	static	CStatTreeItemSimple*		s_kadRequestTimeout;
+	static	CStatTreeItemSimple*		s_kadExpiredRequests;
+	static	CStatTreeItemSimple*		s_kadResponseRate;
+	static	CStatTreeItemSimple*		s_kadParallelism;
+	static	CStatTreeItemSimple*		s_kadFirstResultMedian;
+	static	CStatTreeItemSimple*		s_kadFirstResult90;
+	static	CStatTreeItemSimple*		s_kadConvergedMedian;
+	static	CStatTreeItemSimple*		s_kadConverged90;
+	static	CStatTreeItemBase*		s_kadPackets;
+	static	CStatTreeItemSimple*		s_kadPacketsDropped;
+	static	CStatTreeItemSimple*		s_kadOpcodes[256];
+	static	CStatTreeItemSimple*		s_rejectedFiltered;
+	static	CStatTreeItemSimple*		s_rejectedBanned;
+	static	CStatTreeItemSimple*		s_rejectedFlooding;
 
 	// Clients
 	static	CStatTreeItemHiddenCounter*	s_clients;
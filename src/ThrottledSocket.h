@@ -51,5 +51,16 @@ public:
     virtual uint32	GetNeededBytes() = 0;
 };
 
+
+class ThrottledReceiveSocket
+{
+public:
+	virtual ~ThrottledReceiveSocket() {}
+	virtual uint32	GrantReceiveBudget(uint32 maxNumberOfBytesToReceive) = 0;
+	virtual uint32	RevokeReceiveBudget() = 0;
+	virtual bool	IsReceivePending() = 0;
+	virtual void	DisableReceiveLimit() = 0;
+};
+
 #endif
 // File_checked_for_headers
@@ -0,0 +1,192 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <vector>
+
+#include "Types.h"
+
+
+/**
+ * Hierarchical timing wheel holding values until a deadline has passed.
+ *
+ * Deadlines are GetTickCount() timestamps, rounded up to multiples of the
+ * resolution given to the constructor. The first wheel holds the values
+ * due within SLOTS ticks, one slot per tick, and each of the following
+ * wheels covers SLOTS times as long with slots as long as the whole
+ * previous wheel. When the first wheel has turned around, the next slot
+ * of the second wheel is spread over it, and so on. Adding a value and
+ * collecting it when due are therefore both constant time, and Expire()
+ * only touches the values that are actually due (plus the slots passed),
+ * however many are waiting.
+ *
+ * Values can't be removed before they are due. Users that need to cancel
+ * or move a deadline should just add the new one and ignore the values
+ * whose deadline turns out to be stale when they expire.
+ */
+template <typename VALUE>
+class CTimerWheel
+{
+public:
+	/**
+	 * Constructor.
+	 *
+	 * @param resolution The length of a tick in milliseconds.
+	 * @param now The current GetTickCount().
+	 */
+	CTimerWheel(uint32 resolution, uint32 now)
+		: m_resolution(resolution),
+		  m_lastTime(now),
+		  m_tick(0),
+		  m_size(0)
+	{
+	}
+
+
+	/**
+	 * Adds a value to be returned by Expire() once deadline has passed.
+	 *
+	 * Deadlines in the past are due on the next tick. Deadlines beyond the
+	 * range of the wheels (SLOTS^LEVELS ticks) are clamped to it.
+	 */
+	void Add(const VALUE& value, uint32 deadline)
+	{
+		sint32 delay = (sint32)(deadline - m_lastTime);
+		uint32 ticks = 1;
+		if (delay > 0) {
+			ticks = ((uint32)delay + m_resolution - 1) / m_resolution;
+			if (ticks > MAX_TICKS) {
+				ticks = MAX_TICKS;
+			}
+		}
+
+		Insert(Entry(value, m_tick + ticks));
+		++m_size;
+	}
+
+
+	/**
+	 * Moves the values whose deadline has passed at 'now' to the end of 'due'.
+	 */
+	void Expire(uint32 now, std::vector<VALUE>& due)
+	{
+		uint32 ticks = (now - m_lastTime) / m_resolution;
+		m_lastTime += ticks * m_resolution;
+
+		if (m_size == 0) {
+			// Nothing to cascade, jump straight to the current tick
+			m_tick += ticks;
+			return;
+		}
+
+		for (; ticks && m_size; --ticks) {
+			++m_tick;
+
+			// Spread the next slot of each wheel that has turned around
+			uint32 index = m_tick;
+			for (unsigned level = 1; level < LEVELS && (index & SLOT_MASK) == 0; ++level) {
+				index >>= SLOT_BITS;
+				Cascade(m_slots[level][index & SLOT_MASK]);
+			}
+
+			Slot& slot = m_slots[0][m_tick & SLOT_MASK];
+			for (typename Slot::iterator it = slot.begin(); it != slot.end(); ++it) {
+				due.push_back(it->value);
+			}
+			m_size -= slot.size();
+			slot.clear();
+		}
+
+		m_tick += ticks;
+	}
+
+
+	/**
+	 * Returns the number of values waiting in the wheel.
+	 */
+	size_t size() const	{ return m_size; }
+
+	/**
+	 * Returns true if no values are waiting.
+	 */
+	bool empty() const	{ return m_size == 0; }
+
+private:
+	static const unsigned SLOT_BITS = 6;
+	static const unsigned SLOTS = 1 << SLOT_BITS;
+	static const unsigned SLOT_MASK = SLOTS - 1;
+	static const unsigned LEVELS = 4;
+	static const uint32 MAX_TICKS = (1u << (SLOT_BITS * LEVELS)) - 1;
+
+	struct Entry {
+		Entry(const VALUE& v, uint32 t) : value(v), tick(t) {}
+
+		VALUE	value;
+		//! The tick on which the value is due.
+		uint32	tick;
+	};
+
+	typedef std::vector<Entry> Slot;
+
+
+	//! Puts an entry in the slot of the smallest wheel that covers its tick.
+	void Insert(const Entry& entry)
+	{
+		uint32 ticks = entry.tick - m_tick;
+		unsigned level = 0;
+		while (level < LEVELS - 1 && ticks >= (1u << (SLOT_BITS * (level + 1)))) {
+			++level;
+		}
+
+		m_slots[level][(entry.tick >> (SLOT_BITS * level)) & SLOT_MASK].push_back(entry);
+	}
+
+	//! Moves the entries of a slot to the smaller wheels.
+	void Cascade(Slot& slot)
+	{
+		Slot entries;
+		entries.swap(slot);
+		for (typename Slot::iterator it = entries.begin(); it != entries.end(); ++it) {
+			Insert(*it);
+		}
+	}
+
+
+	//! The length of a tick in milliseconds.
+	uint32	m_resolution;
+	//! The GetTickCount() at which m_tick started.
+	uint32	m_lastTime;
+	//! The last tick processed by Expire().
+	uint32	m_tick;
+	//! The number of values waiting.
+	size_t	m_size;
+
+	Slot	m_slots[LEVELS][SLOTS];
+};
+
+#endif // TIMERWHEEL_H
+// File_checked_for_headers
@@ -88,6 +88,7 @@ public:
 	CFriend*			GetFriend() const						{ return m_Friend; }
 	bool				GetFriendSlot() const					{ return m_bFriendSlot; }
 	wxString			GetFullIP() const						{ return Uint32toStringIP(m_dwUserIP); }
+	uint32				GetFullUserIP() const					{ return m_dwUserIP; }
 	uint16				GetKadPort() const						{ return m_nKadPort; }
 	float				GetKBpsDown() const						{ return m_kBpsDown; }
 	uint32				GetIP() const							{ return m_dwUserIP; }
@@ -286,7 +286,6 @@ void CUpDownClient::CreateStandardPackets(const byte* buffer, uint32 togo, Reque
 {
 	uint32 nPacketSize;
 
-	CMemFile memfile(buffer, togo);
 	if (togo > 10240) {
 		nPacketSize = togo/(uint32)(togo/10240);
 	} else {
@@ -305,22 +304,22 @@ void CUpDownClient::CreateStandardPackets(const byte* buffer, uint32 togo, Reque
 		uint64 startpos = endpos - nPacketSize;
 
 		bool bLargeBlocks = (startpos > 0xFFFFFFFF) || (endpos > 0xFFFFFFFF);
+		uint32 headerSize = 16 + 2 * (bLargeBlocks ? 8 :4);
 
-		CMemFile data(nPacketSize + 16 + 2 * (bLargeBlocks ? 8 :4));
-		data.WriteHash(GetUploadFileID());
+		// Fill the packet in place, so the file data is copied only once
+		CPacket* packet = new CPacket((bLargeBlocks ? (uint8)OP_SENDINGPART_I64 : (uint8)OP_SENDINGPART), headerSize + nPacketSize, (bLargeBlocks ? OP_EMULEPROT : OP_EDONKEYPROT), false);
+		packet->Copy16ToDataBuffer(GetUploadFileID().GetHash());
 		if (bLargeBlocks) {
-			data.WriteUInt64(startpos);
-			data.WriteUInt64(endpos);
+			packet->CopyUInt64ToDataBuffer(startpos, 16);
+			packet->CopyUInt64ToDataBuffer(endpos, 24);
 		} else {
-			data.WriteUInt32(startpos);
-			data.WriteUInt32(endpos);
+			packet->CopyUInt32ToDataBuffer(startpos, 16);
+			packet->CopyUInt32ToDataBuffer(endpos, 20);
 		}
-		char *tempbuf = new char[nPacketSize];
-		memfile.Read(tempbuf, nPacketSize);
-		data.Write(tempbuf, nPacketSize);
-		delete [] tempbuf;
-		CPacket* packet = new CPacket(data, (bLargeBlocks ? OP_EMULEPROT : OP_EDONKEYPROT), (bLargeBlocks ? (uint8)OP_SENDINGPART_I64 : (uint8)OP_SENDINGPART));
-		theStats::AddUpOverheadFileRequest(16 + 2 * (bLargeBlocks ? 8 :4));
+		packet->CopyToDataBuffer(headerSize, buffer, nPacketSize);
+		buffer += nPacketSize;
+
+		theStats::AddUpOverheadFileRequest(headerSize);
 		theStats::AddUploadToSoft(GetClientSoft(), nPacketSize);
 		AddDebugLogLineN(logLocalClient,
 			CFormat(wxT("Local Client: %s to %s"))
@@ -340,7 +339,7 @@ void CUpDownClient::CreatePackedPackets(const byte* buffer, uint32 togo, Request
 		return;
 	}
 
-	CMemFile memfile(output.get(), newsize);
+	const byte* compressed = output.get();
 
 	uint32 totalPayloadSize = 0;
 	uint32 oldSize = togo;
@@ -360,19 +359,20 @@ void CUpDownClient::CreatePackedPackets(const byte* buffer, uint32 togo, Request
 
 		bool isLargeBlock = (currentblock->StartOffset > 0xFFFFFFFF) || (currentblock->EndOffset > 0xFFFFFFFF);
 
-		CMemFile data(nPacketSize + 16 + (isLargeBlock ? 12 : 8));
-		data.WriteHash(GetUploadFileID());
+		uint32 headerSize = 16 + (isLargeBlock ? 12 : 8);
+
+		// Fill the packet in place, so the compressed data is copied only once
+		CPacket* packet = new CPacket((isLargeBlock ? (uint8)OP_COMPRESSEDPART_I64 : (uint8)OP_COMPRESSEDPART), headerSize + nPacketSize, OP_EMULEPROT, false);
+		packet->Copy16ToDataBuffer(GetUploadFileID().GetHash());
 		if (isLargeBlock) {
-			data.WriteUInt64(currentblock->StartOffset);
+			packet->CopyUInt64ToDataBuffer(currentblock->StartOffset, 16);
+			packet->CopyUInt32ToDataBuffer(newsize, 24);
 		} else {
-			data.WriteUInt32(currentblock->StartOffset);
+			packet->CopyUInt32ToDataBuffer(currentblock->StartOffset, 16);
+			packet->CopyUInt32ToDataBuffer(newsize, 20);
 		}
-		data.WriteUInt32(newsize);
-		char *tempbuf = new char[nPacketSize];
-		memfile.Read(tempbuf, nPacketSize);
-		data.Write(tempbuf,nPacketSize);
-		delete [] tempbuf;
-		CPacket* packet = new CPacket(data, OP_EMULEPROT, (isLargeBlock ? OP_COMPRESSEDPART_I64 : OP_COMPRESSEDPART));
+		packet->CopyToDataBuffer(headerSize, compressed, nPacketSize);
+		compressed += nPacketSize;
 
 		// approximate payload size
 		uint32 payloadSize = nPacketSize*oldSize/newsize;
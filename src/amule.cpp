@@ -50,8 +50,10 @@
 #include <common/Format.h>		// Needed for CFormat
 #include "kademlia/kademlia/Kademlia.h"
 #include "kademlia/kademlia/Prefs.h"
+#include "kademlia/kademlia/SearchManager.h"
 #include "kademlia/kademlia/UDPFirewallTester.h"
 #include "CanceledFileList.h"
+#include "AsyncDNS.h"			// Needed for CAsyncDNS
 #include "ClientCreditsList.h"		// Needed for CClientCreditsList
 #include "ClientList.h"			// Needed for CClientList
 #include "ClientUDPSocket.h"		// Needed for CClientUDPSocket & CMuleUDPSocket
@@ -79,6 +81,8 @@
 #include "ThreadTasks.h"
 #include "UploadQueue.h"		// Needed for CUploadQueue
 #include "UploadBandwidthThrottler.h"
+#include "DownloadBandwidthThrottler.h"
+#include "PacketBufferPool.h"		// Needed for CPacketBufferPool
 #include "UserEvents.h"
 #include "ScopedPtr.h"
 
@@ -202,6 +206,7 @@ CamuleApp::CamuleApp()
 	glob_prefs	= NULL;
 	m_statistics	= NULL;
 	uploadBandwidthThrottler = NULL;
+	downloadBandwidthThrottler = NULL;
 #ifdef ENABLE_UPNP
 	m_upnp		= NULL;
 	m_upnpMappings.resize(4);
@@ -327,6 +332,11 @@ int CamuleApp::OnExit()
 	delete uploadBandwidthThrottler;
 	uploadBandwidthThrottler = NULL;
 
+	delete downloadBandwidthThrottler;
+	downloadBandwidthThrottler = NULL;
+
+	CPacketBufferPool::Clear();
+
 #ifdef ASIO_SOCKETS
 	delete m_AsioService;
 	m_AsioService = NULL;
@@ -562,6 +572,7 @@ bool CamuleApp::OnInit()
 	// (when using posix threads) only replicates the mainthread,
 	// and the UBT constructor creates a thread.
 	uploadBandwidthThrottler = new UploadBandwidthThrottler();
+	downloadBandwidthThrottler = new DownloadBandwidthThrottler();
 
 #ifdef ASIO_SOCKETS
 	m_AsioService = new CAsioService;
@@ -1188,10 +1199,19 @@ void CamuleApp::OnCoreTimer(CTimerEvent& WXUNUSED(evt))
 	recurse = true;
 
 	uploadqueue->Process();
+	// Handle the UDP packets that arrived meanwhile, so Kad requests aren't
+	// kept waiting until the whole timer is done.
+	clientudp->ReceivePending();
 	downloadqueue->Process();
+	clientudp->ReceivePending();
 	//theApp->clientcredits->Process();
 	theStats::CalculateRates();
 
+	// Replace the Kad lookup requests that timed out
+	if (Kademlia::CKademlia::IsRunning()) {
+		Kademlia::CSearchManager::ExpireRequests();
+	}
+
 	if (msCur-msPrevHist > 1000) {
 		// unlike the other loop counters in this function this one will sometimes
 		// produce two calls in quick succession (if there was a gap of more than one
@@ -1406,6 +1426,9 @@ void CamuleApp::ShutDown()
 	// Exit HTTP downloads
 	CHTTPDownloadThread::StopAll();
 
+	// Drop pending DNS lookups
+	CAsyncDNS::Terminate();
+
 	// Exit thread scheduler and upload thread
 	CThreadScheduler::Terminate();
 
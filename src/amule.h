@@ -67,6 +67,7 @@ class CFriendList;
 class CClientUDPSocket;
 class CIPFilter;
 class UploadBandwidthThrottler;
+class DownloadBandwidthThrottler;
 #ifdef ASIO_SOCKETS
 class CAsioService;
 #else
@@ -277,6 +278,7 @@ public:
 	CStatistics*		m_statistics;
 	CIPFilter*		ipfilter;
 	UploadBandwidthThrottler* uploadBandwidthThrottler;
+	DownloadBandwidthThrottler* downloadBandwidthThrottler;
 #ifdef ASIO_SOCKETS
 	CAsioService*		m_AsioService;
 #endif
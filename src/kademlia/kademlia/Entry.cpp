@@ -116,6 +116,16 @@ void CEntry::SetFileName(const wxString& name)
 	}
 	sFileNameEntry sFN = { name, 1 };
 	m_filenames.push_front(sFN);
+	FileNamesChanged();
+}
+
+const wxString& CEntry::GetCommonFileNameLowerCase() const
+{
+	if (!m_commonFileNameLowerValid) {
+		m_commonFileNameLower = GetCommonFileName().MakeLower();
+		m_commonFileNameLowerValid = true;
+	}
+	return m_commonFileNameLower;
 }
 
 wxString CEntry::GetCommonFileName() const
@@ -181,136 +191,118 @@ CKeyEntry::~CKeyEntry()
 	}
 }
 
-bool CKeyEntry::SearchTermsMatch(const SSearchTerm* searchTerm) const
+template<typename T>
+static bool CompareSearchValue(SSearchTerm::ESearchTermType op, T value, T searchValue)
 {
-	// boolean operators
-	if (searchTerm->type == SSearchTerm::AND) {
-		return SearchTermsMatch(searchTerm->left) && SearchTermsMatch(searchTerm->right);
+	switch (op) {
+		case SSearchTerm::OpGreaterEqual:	return value >= searchValue;
+		case SSearchTerm::OpLessEqual:		return value <= searchValue;
+		case SSearchTerm::OpGreater:		return value > searchValue;
+		case SSearchTerm::OpLess:		return value < searchValue;
+		case SSearchTerm::OpEqual:		return value == searchValue;
+		case SSearchTerm::OpNotEqual:		return value != searchValue;
+		default:				return false;
 	}
+}
 
-	if (searchTerm->type == SSearchTerm::OR) {
-		return SearchTermsMatch(searchTerm->left) || SearchTermsMatch(searchTerm->right);
-	}
+bool CKeyEntry::SearchTermsMatch(const CSearchTermProgram& program) const
+{
+	uint32_t index = 0;
+	return SearchTermsMatch(program, index);
+}
 
-	if (searchTerm->type == SSearchTerm::NOT) {
-		return SearchTermsMatch(searchTerm->left) && !SearchTermsMatch(searchTerm->right);
+bool CKeyEntry::SearchTermsMatch(const CSearchTermProgram& program, uint32_t& index) const
+{
+	const CSearchTermProgram::SInstruction& term = program[index];
+	index++;
+
+	// boolean operators, the right side is skipped once the result is known
+	switch (term.type) {
+		case SSearchTerm::AND:
+			if (!SearchTermsMatch(program, index)) {
+				index = term.end;
+				return false;
+			}
+			return SearchTermsMatch(program, index);
+
+		case SSearchTerm::OR:
+			if (SearchTermsMatch(program, index)) {
+				index = term.end;
+				return true;
+			}
+			return SearchTermsMatch(program, index);
+
+		case SSearchTerm::NOT:
+			if (!SearchTermsMatch(program, index)) {
+				index = term.end;
+				return false;
+			}
+			return !SearchTermsMatch(program, index);
+
+		default:
+			return SearchTermMatches(program, index - 1);
 	}
+}
+
+bool CKeyEntry::SearchTermMatches(const CSearchTermProgram& program, uint32_t index) const
+{
+	const CSearchTermProgram::SInstruction& term = program[index];
 
 	// word which is to be searched in the file name (and in additional meta data as done by some ed2k servers???)
-	if (searchTerm->type == SSearchTerm::String) {
-		int strSearchTerms = searchTerm->astr->GetCount();
-		if (strSearchTerms == 0) {
+	if (term.type == SSearchTerm::String) {
+		if (term.words.empty()) {
 			return false;
 		}
 		// if there are more than one search strings specified (e.g. "aaa bbb ccc") the entire string is handled
 		// like "aaa AND bbb AND ccc". search all strings from the string search term in the tokenized list of
 		// the file name. all strings of string search term have to be found (AND)
-		wxString commonFileNameLower(GetCommonFileNameLowerCase());
-		for (int i = 0; i < strSearchTerms; i++) {
+		const wxString& commonFileNameLower = GetCommonFileNameLowerCase();
+		for (std::vector<wxString>::const_iterator it = term.words.begin(); it != term.words.end(); ++it) {
 			// this will not give the same results as when tokenizing the filename string, but it is 20 times faster.
-			if (commonFileNameLower.Find((*(searchTerm->astr))[i]) == -1) {
+			if (commonFileNameLower.Find(*it) == -1) {
 				return false;
 			}
 		}
 		return true;
 	}
 
-	if (searchTerm->type == SSearchTerm::MetaTag) {
-		if (searchTerm->tag->GetType() == 2) {	// meta tags with string values
-			if (searchTerm->tag->GetName() == TAG_FILEFORMAT) {
-				// 21-Sep-2006 []: Special handling for TAG_FILEFORMAT which is already part
-				// of the filename and thus does not need to get published nor stored explicitly,
-				wxString commonFileName(GetCommonFileName());
-				int ext = commonFileName.Find(wxT('.'), true);
-				if (ext != wxNOT_FOUND) {
-					return commonFileName.Mid(ext + 1).CmpNoCase(searchTerm->tag->GetStr()) == 0;
-				}
-			} else {
-				for (TagPtrList::const_iterator it = m_taglist.begin(); it != m_taglist.end(); ++it) {
-					if ((*it)->IsStr() && searchTerm->tag->GetName() == (*it)->GetName()) {
-						return (*it)->GetStr().CmpNoCase(searchTerm->tag->GetStr()) == 0;
-					}
-				}
-			}
-		}
-	} else if (searchTerm->type == SSearchTerm::OpGreaterEqual) {
-		if (searchTerm->tag->IsInt()) {	// meta tags with integer values
-			uint64_t value;
-			if (GetIntTagValue(searchTerm->tag->GetName(), value, true)) {
-				return value >= searchTerm->tag->GetInt();
-			}
-		} else if (searchTerm->tag->IsFloat()) {	// meta tags with float values
-			for (TagPtrList::const_iterator it = m_taglist.begin(); it != m_taglist.end(); ++it) {
-				if ((*it)->IsFloat() && searchTerm->tag->GetName() == (*it)->GetName()) {
-					return (*it)->GetFloat() >= searchTerm->tag->GetFloat();
-				}
-			}
+	switch (term.valueType) {
+		case CSearchTermProgram::ValueFileFormat: {
+			// 21-Sep-2006 []: Special handling for TAG_FILEFORMAT which is already part
+			// of the filename and thus does not need to get published nor stored explicitly,
+			const wxString& commonFileName = GetCommonFileNameLowerCase();
+			int ext = commonFileName.Find(wxT('.'), true);
+			return ext != wxNOT_FOUND && commonFileName.length() == (size_t)ext + 1 + term.strValue.length() && commonFileName.EndsWith(term.strValue);
 		}
-	} else if (searchTerm->type == SSearchTerm::OpLessEqual) {
-		if (searchTerm->tag->IsInt()) {	// meta tags with integer values
-			uint64_t value;
-			if (GetIntTagValue(searchTerm->tag->GetName(), value, true)) {
-				return value <= searchTerm->tag->GetInt();
-			}
-		} else if (searchTerm->tag->IsFloat()) {	// meta tags with float values
-			for (TagPtrList::const_iterator it = m_taglist.begin(); it != m_taglist.end(); ++it) {
-				if ((*it)->IsFloat() && searchTerm->tag->GetName() == (*it)->GetName()) {
-					return (*it)->GetFloat() <= searchTerm->tag->GetFloat();
-				}
-			}
-		}
-	} else if (searchTerm->type == SSearchTerm::OpGreater) {
-		if (searchTerm->tag->IsInt()) {	// meta tags with integer values
-			uint64_t value;
-			if (GetIntTagValue(searchTerm->tag->GetName(), value, true)) {
-				return value > searchTerm->tag->GetInt();
-			}
-		} else if (searchTerm->tag->IsFloat()) {	// meta tags with float values
-			for (TagPtrList::const_iterator it = m_taglist.begin(); it != m_taglist.end(); ++it) {
-				if ((*it)->IsFloat() && searchTerm->tag->GetName() == (*it)->GetName()) {
-					return (*it)->GetFloat() > searchTerm->tag->GetFloat();
-				}
-			}
-		}
-	} else if (searchTerm->type == SSearchTerm::OpLess) {
-		if (searchTerm->tag->IsInt()) {	// meta tags with integer values
-			uint64_t value;
-			if (GetIntTagValue(searchTerm->tag->GetName(), value, true)) {
-				return value < searchTerm->tag->GetInt();
-			}
-		} else if (searchTerm->tag->IsFloat()) {	// meta tags with float values
+
+		case CSearchTermProgram::ValueString:
 			for (TagPtrList::const_iterator it = m_taglist.begin(); it != m_taglist.end(); ++it) {
-				if ((*it)->IsFloat() && searchTerm->tag->GetName() == (*it)->GetName()) {
-					return (*it)->GetFloat() < searchTerm->tag->GetFloat();
+				if ((*it)->IsStr() && term.tagName == (*it)->GetName()) {
+					return (*it)->GetStr().CmpNoCase(term.strValue) == 0;
 				}
 			}
-		}
-	} else if (searchTerm->type == SSearchTerm::OpEqual) {
-		if (searchTerm->tag->IsInt()) {	// meta tags with integer values
+			break;
+
+		case CSearchTermProgram::ValueInt: {
+			// meta tags with integer values
 			uint64_t value;
-			if (GetIntTagValue(searchTerm->tag->GetName(), value, true)) {
-				return value == searchTerm->tag->GetInt();
-			}
-		} else if (searchTerm->tag->IsFloat()) {	// meta tags with float values
-			for (TagPtrList::const_iterator it = m_taglist.begin(); it != m_taglist.end(); ++it) {
-				if ((*it)->IsFloat() && searchTerm->tag->GetName() == (*it)->GetName()) {
-					return (*it)->GetFloat() == searchTerm->tag->GetFloat();
-				}
+			if (GetIntTagValue(term.tagName, value, true)) {
+				return CompareSearchValue(term.type, value, term.intValue);
 			}
+			break;
 		}
-	} else if (searchTerm->type == SSearchTerm::OpNotEqual) {
-		if (searchTerm->tag->IsInt()) {	// meta tags with integer values
-			uint64_t value;
-			if (GetIntTagValue(searchTerm->tag->GetName(), value, true)) {
-				return value != searchTerm->tag->GetInt();
-			}
-		} else if (searchTerm->tag->IsFloat()) {	// meta tags with float values
+
+		case CSearchTermProgram::ValueFloat:
+			// meta tags with float values
 			for (TagPtrList::const_iterator it = m_taglist.begin(); it != m_taglist.end(); ++it) {
-				if ((*it)->IsFloat() && searchTerm->tag->GetName() == (*it)->GetName()) {
-					return (*it)->GetFloat() != searchTerm->tag->GetFloat();
+				if ((*it)->IsFloat() && term.tagName == (*it)->GetName()) {
+					return CompareSearchValue(term.type, (*it)->GetFloat(), term.floatValue);
 				}
 			}
-		}
+			break;
+
+		case CSearchTermProgram::ValueNone:
+			break;
 	}
 
 	return false;
@@ -414,6 +406,7 @@ void CKeyEntry::MergeIPsAndFilenames(CKeyEntry* fromEntry)
 		if (!duplicate) {
 			m_filenames.push_back(currentName);
 		}
+		FileNamesChanged();
 	}
 
 	// if this was a refresh done, otherwise update the global track map
@@ -538,6 +531,7 @@ void CKeyEntry::ReadPublishTrackingDataFromFile(CFileDataIO* data)
 		toAdd.m_popularityIndex = data->ReadUInt32();
 		m_filenames.push_back(toAdd);
 	}
+	FileNamesChanged();
 
 	wxASSERT(m_publishingIPs == NULL);
 	m_publishingIPs = new PublishingIPList();
@@ -46,13 +46,14 @@ there client on the eMule forum..
 #include <list>
 #include <map>
 
-struct SSearchTerm;
 class CFileDataIO;
 
 ////////////////////////////////////////
 namespace Kademlia {
 ////////////////////////////////////////
 
+class CSearchTermProgram;
+
 class CEntry
 {
 protected:
@@ -70,6 +71,7 @@ public:
 		m_uSize = 0;
 		m_tLifeTime = time(NULL);
 		m_bSource = false;
+		m_commonFileNameLowerValid = false;
 	}
 
 	virtual		~CEntry();
@@ -83,7 +85,7 @@ public:
 	uint32_t GetTagCount() const			{ return m_taglist.size() + ((m_uSize != 0) ? 1 : 0) + (GetCommonFileName().IsEmpty() ? 0 : 1); }
 	void	 WriteTagList(CFileDataIO* data)	{ WriteTagListInc(data, 0); }
 
-	wxString GetCommonFileNameLowerCase() const	{ return GetCommonFileName().MakeLower(); }
+	const wxString& GetCommonFileNameLowerCase() const;
 	wxString GetCommonFileName() const;
 	void	 SetFileName(const wxString& name);
 
@@ -98,9 +100,17 @@ public:
 
 protected:
 	void	WriteTagListInc(CFileDataIO *data, uint32_t increaseTagNumber = 0);
+	//! Must be called whenever m_filenames changes.
+	void	FileNamesChanged()			{ m_commonFileNameLowerValid = false; }
 	typedef std::list<sFileNameEntry>	FileNameList;
 	FileNameList	m_filenames;
 	TagPtrList	m_taglist;
+
+private:
+	// Keyword searches match every entry against the lower-case name,
+	// so it is only built again when the names change.
+	mutable wxString	m_commonFileNameLower;
+	mutable bool		m_commonFileNameLowerValid;
 };
 
 class CKeyEntry : public CEntry
@@ -118,7 +128,7 @@ class CKeyEntry : public CEntry
 	virtual CEntry*	Copy() const			{ return CEntry::Copy(); }
 	virtual bool	IsKeyEntry() const throw()	{ return true; }
 
-	bool	SearchTermsMatch(const SSearchTerm *searchTerm) const;
+	bool	SearchTermsMatch(const CSearchTermProgram& program) const;
 	void	MergeIPsAndFilenames(CKeyEntry* fromEntry);
 	void	CleanUpTrackedPublishers();
 	double	GetTrustValue();
@@ -129,6 +139,8 @@ class CKeyEntry : public CEntry
 	static void	ResetGlobalTrackingMap()	{ s_globalPublishIPs.clear(); }
 
       protected:
+	bool	SearchTermsMatch(const CSearchTermProgram& program, uint32_t& index) const;
+	bool	SearchTermMatches(const CSearchTermProgram& program, uint32_t index) const;
 	void	ReCalculateTrustValue();
 	static void	AdjustGlobalPublishTracking(uint32_t ip, bool increase, const wxString& dbgReason);
 
@@ -47,33 +47,128 @@ there client on the eMule forum..
 #include <common/Macros.h>
 #include <tags/FileTags.h>
 
+#include <vector>
+
 #include "../routing/Contact.h"
 #include "../net/KademliaUDPListener.h"
 #include "../utils/KadUDPKey.h"
 #include "../../CFile.h"
 #include "../../MemFile.h"
-#include "../../Preferences.h"
 #include "../../Logger.h"
+#include "../../ScopedPtr.h"
 
 ////////////////////////////////////////
 using namespace Kademlia;
 ////////////////////////////////////////
 
-wxString CIndexed::m_kfilename;
-wxString CIndexed::m_sfilename;
-wxString CIndexed::m_loadfilename;
+// Source entries are grouped by the time slot they expire in, so Clean()
+// only has to look at the keys with entries in the slots that are over.
+static const time_t SOURCE_EXPIRY_SLOT = MIN2S(30);
+// How often the index is saved while running, so a crash doesn't lose it.
+static const time_t INDEX_SAVE_INTERVAL = HR2S(2);
+
+// Reads a whole index file into memory. Parsing the records from memory
+// saves a system call for every single field.
+static bool ReadIndexFile(const wxString& filename, std::vector<byte>& buffer)
+{
+	CFile file;
+	if (!CPath::FileExists(filename) || !file.Open(filename, CFile::read)) {
+		return false;
+	}
+
+	uint64 length = file.GetLength();
+	if (length == 0) {
+		return false;
+	}
+
+	buffer.resize(length);
+	file.Read(&buffer[0], length);
 
-CIndexed::CIndexed()
+	return true;
+}
+
+// The size of the blocks the index files are written in.
+static const size_t INDEX_WRITE_BUFFER = 256 * 1024;
+
+// Writes an index file in blocks of INDEX_WRITE_BUFFER bytes, so neither
+// every field is a system call nor a copy of the whole index is built in
+// memory. The old file is only replaced once Close() has been called.
+class CIndexFileWriter : public CFileDataIO
+{
+public:
+	CIndexFileWriter(const wxString& filename)
+		: m_buffer(INDEX_WRITE_BUFFER), m_used(0), m_written(0)
+	{
+		if (!m_file.Open(filename, CFile::write_safe)) {
+			throw wxString(wxT("Unable to open ")) + filename;
+		}
+	}
+
+	void Close()
+	{
+		Flush();
+		m_file.Close();
+	}
+
+	virtual uint64 GetPosition() const	{ return m_written + m_used; }
+	virtual uint64 GetLength() const	{ return m_written + m_used; }
+
+protected:
+	virtual sint64 doRead(void*, size_t) const	{ return -1; }
+
+	virtual sint64 doWrite(const void* buffer, size_t count)
+	{
+		if (m_used + count > m_buffer.size()) {
+			Flush();
+		}
+
+		if (count >= m_buffer.size()) {
+			m_file.Write(buffer, count);
+			m_written += count;
+		} else {
+			memcpy(&m_buffer[m_used], buffer, count);
+			m_used += count;
+		}
+
+		return count;
+	}
+
+	// The file is only written sequentially
+	virtual sint64 doSeek(sint64 offset) const
+	{
+		return (uint64)offset == GetPosition() ? offset : -1;
+	}
+
+private:
+	void Flush()
+	{
+		if (m_used) {
+			m_file.Write(&m_buffer[0], m_used);
+			m_written += m_used;
+			m_used = 0;
+		}
+	}
+
+	CFile			m_file;
+	std::vector<byte>	m_buffer;
+	size_t			m_used;
+	uint64			m_written;
+};
+
+CIndexed::CIndexed(const wxString& directory)
 {
-	m_sfilename = thePrefs::GetConfigDir() + wxT("src_index.dat");
-	m_kfilename = thePrefs::GetConfigDir() + wxT("key_index.dat");
-	m_loadfilename = thePrefs::GetConfigDir() + wxT("load_index.dat");
 	m_lastClean = time(NULL) + (60*30);
+	m_nextSave = time(NULL) + INDEX_SAVE_INTERVAL;
 	m_totalIndexSource = 0;
 	m_totalIndexKeyword = 0;
 	m_totalIndexNotes = 0;
 	m_totalIndexLoad = 0;
-	ReadFile();
+	if (!directory.IsEmpty()) {
+		m_sfilename = directory + wxT("src_index.dat");
+		m_kfilename = directory + wxT("key_index.dat");
+		m_loadfilename = directory + wxT("load_index.dat");
+		ReadFile();
+	}
 }
 
 void CIndexed::ReadFile()
@@ -83,8 +178,9 @@ void CIndexed::ReadFile()
 		uint32_t totalSource = 0;
 		uint32_t totalKeyword = 0;
 
-		CFile load_file;
-		if (CPath::FileExists(m_loadfilename) && load_file.Open(m_loadfilename, CFile::read)) {
+		std::vector<byte> buffer;
+		if (ReadIndexFile(m_loadfilename, buffer)) {
+			CMemFile load_file((const byte*)&buffer[0], buffer.size());
 			uint32_t version = load_file.ReadUInt32();
 			if (version < 2) {
 				/*time_t savetime =*/ load_file.ReadUInt32(); //  Savetime is unused now
@@ -98,11 +194,10 @@ void CIndexed::ReadFile()
 					numLoad--;
 				}
 			}
-			load_file.Close();
 		}
 
-		CFile k_file;
-		if (CPath::FileExists(m_kfilename) && k_file.Open(m_kfilename, CFile::read)) {
+		if (ReadIndexFile(m_kfilename, buffer)) {
+			CMemFile k_file((const byte*)&buffer[0], buffer.size());
 			uint32_t version = k_file.ReadUInt32();
 			if (version < 4) {
 				time_t savetime = k_file.ReadUInt32();
@@ -173,11 +268,10 @@ void CIndexed::ReadFile()
 					}
 				}
 			}
-			k_file.Close();
 		}
 
-		CFile s_file;
-		if (CPath::FileExists(m_sfilename) && s_file.Open(m_sfilename, CFile::read)) {
+		if (ReadIndexFile(m_sfilename, buffer)) {
+			CMemFile s_file((const byte*)&buffer[0], buffer.size());
 			uint32_t version = s_file.ReadUInt32();
 			if (version < 3) {
 				time_t savetime = s_file.ReadUInt32();
@@ -228,7 +322,6 @@ void CIndexed::ReadFile()
 					}
 				}
 			}
-			s_file.Close();
 		}
 
 		m_totalIndexSource = totalSource;
@@ -246,6 +339,69 @@ void CIndexed::ReadFile()
 
 CIndexed::~CIndexed()
 {
+	WriteFile();
+
+	for (LoadMap::iterator it = m_Load_map.begin(); it != m_Load_map.end(); ++it) {
+		delete it->second;
+	}
+
+	for (SrcHashMap::iterator itSrcHash = m_Sources_map.begin(); itSrcHash != m_Sources_map.end(); ++itSrcHash) {
+		SrcHash* currSrcHash = itSrcHash->second;
+		CKadSourcePtrList& KeyHashSrcMap = currSrcHash->m_Source_map;
+
+		for (CKadSourcePtrList::iterator itSource = KeyHashSrcMap.begin(); itSource != KeyHashSrcMap.end(); ++itSource) {
+			Source* currSource = *itSource;
+			CKadEntryPtrList& SrcEntryList = currSource->entryList;
+			for (CKadEntryPtrList::iterator itEntry = SrcEntryList.begin(); itEntry != SrcEntryList.end(); ++itEntry) {
+				delete *itEntry;
+			}
+			delete currSource;
+		}
+		delete currSrcHash;
+	}
+
+	for (KeyHashMap::iterator itKeyHash = m_Keyword_map.begin(); itKeyHash != m_Keyword_map.end(); ++itKeyHash) {
+		KeyHash* currKeyHash = itKeyHash->second;
+		CSourceKeyMap& KeyHashSrcMap = currKeyHash->m_Source_map;
+
+		for (CSourceKeyMap::iterator itSource = KeyHashSrcMap.begin(); itSource != KeyHashSrcMap.end(); ++itSource) {
+			Source* currSource = itSource->second;
+			CKadEntryPtrList& SrcEntryList = currSource->entryList;
+			for (CKadEntryPtrList::iterator itEntry = SrcEntryList.begin(); itEntry != SrcEntryList.end(); ++itEntry) {
+				Kademlia::CKeyEntry* currName = static_cast<Kademlia::CKeyEntry*>(*itEntry);
+				currName->DirtyDeletePublishData();
+				delete currName;
+			}
+			delete currSource;
+		}
+		CKeyEntry::ResetGlobalTrackingMap();
+		delete currKeyHash;
+	}
+
+	for (SrcHashMap::iterator itNoteHash = m_Notes_map.begin(); itNoteHash != m_Notes_map.end(); ++itNoteHash) {
+		SrcHash* currNoteHash = itNoteHash->second;
+		CKadSourcePtrList& KeyHashNoteMap = currNoteHash->m_Source_map;
+
+		for (CKadSourcePtrList::iterator itNote = KeyHashNoteMap.begin(); itNote != KeyHashNoteMap.end(); ++itNote) {
+			Source* currNote = *itNote;
+			CKadEntryPtrList& NoteEntryList = currNote->entryList;
+			for (CKadEntryPtrList::iterator itNoteEntry = NoteEntryList.begin(); itNoteEntry != NoteEntryList.end(); ++itNoteEntry) {
+				delete *itNoteEntry;
+			}
+			delete currNote;
+		}
+		delete currNoteHash;
+	}
+
+	m_Notes_map.clear();
+}
+
+void CIndexed::WriteFile()
+{
+	if (m_kfilename.IsEmpty()) {
+		return;
+	}
+
 	try
 	{
 		time_t now = time(NULL);
@@ -253,126 +409,95 @@ CIndexed::~CIndexed()
 		uint32_t k_total = 0;
 		uint32_t l_total = 0;
 
-		CFile load_file;
-		if (load_file.Open(m_loadfilename, CFile::write)) {
-			load_file.WriteUInt32(1); // version
-			load_file.WriteUInt32(now);
-			wxASSERT(m_Load_map.size() < 0xFFFFFFFF);
-			load_file.WriteUInt32((uint32_t)m_Load_map.size());
-			for (LoadMap::iterator it = m_Load_map.begin(); it != m_Load_map.end(); ++it ) {
-				Load* load = it->second;
-				wxASSERT(load);
-				if (load) {
-					load_file.WriteUInt128(load->keyID);
-					load_file.WriteUInt32(load->time);
-					l_total++;
-					delete load;
-				}
+		CIndexFileWriter load_file(m_loadfilename);
+		load_file.WriteUInt32(1); // version
+		load_file.WriteUInt32(now);
+		wxASSERT(m_Load_map.size() < 0xFFFFFFFF);
+		load_file.WriteUInt32((uint32_t)m_Load_map.size());
+		for (LoadMap::iterator it = m_Load_map.begin(); it != m_Load_map.end(); ++it ) {
+			Load* load = it->second;
+			wxASSERT(load);
+			if (load) {
+				load_file.WriteUInt128(load->keyID);
+				load_file.WriteUInt32(load->time);
+				l_total++;
 			}
-			load_file.Close();
 		}
-
-		CFile s_file;
-		if (s_file.Open(m_sfilename, CFile::write)) {
-			s_file.WriteUInt32(2); // version
-			s_file.WriteUInt32(now + KADEMLIAREPUBLISHTIMES);
-			wxASSERT(m_Sources_map.size() < 0xFFFFFFFF);
-			s_file.WriteUInt32((uint32_t)m_Sources_map.size());
-			for (SrcHashMap::iterator itSrcHash = m_Sources_map.begin(); itSrcHash != m_Sources_map.end(); ++itSrcHash ) {
-				SrcHash* currSrcHash = itSrcHash->second;
-				s_file.WriteUInt128(currSrcHash->keyID);
-
-				CKadSourcePtrList& KeyHashSrcMap = currSrcHash->m_Source_map;
-				wxASSERT(KeyHashSrcMap.size() < 0xFFFFFFFF);
-				s_file.WriteUInt32((uint32_t)KeyHashSrcMap.size());
-
-				for (CKadSourcePtrList::iterator itSource = KeyHashSrcMap.begin(); itSource != KeyHashSrcMap.end(); ++itSource) {
-					Source* currSource = *itSource;
-					s_file.WriteUInt128(currSource->sourceID);
-
-					CKadEntryPtrList& SrcEntryList = currSource->entryList;
-					wxASSERT(SrcEntryList.size() < 0xFFFFFFFF);
-					s_file.WriteUInt32((uint32_t)SrcEntryList.size());
-					for (CKadEntryPtrList::iterator itEntry = SrcEntryList.begin(); itEntry != SrcEntryList.end(); ++itEntry) {
-						Kademlia::CEntry* currName = *itEntry;
-						s_file.WriteUInt32(currName->m_tLifeTime);
-						currName->WriteTagList(&s_file);
-						delete currName;
-						s_total++;
-					}
-					delete currSource;
+		load_file.Close();
+
+		CIndexFileWriter s_file(m_sfilename);
+		s_file.WriteUInt32(2); // version
+		s_file.WriteUInt32(now + KADEMLIAREPUBLISHTIMES);
+		wxASSERT(m_Sources_map.size() < 0xFFFFFFFF);
+		s_file.WriteUInt32((uint32_t)m_Sources_map.size());
+		for (SrcHashMap::iterator itSrcHash = m_Sources_map.begin(); itSrcHash != m_Sources_map.end(); ++itSrcHash ) {
+			SrcHash* currSrcHash = itSrcHash->second;
+			s_file.WriteUInt128(currSrcHash->keyID);
+
+			CKadSourcePtrList& KeyHashSrcMap = currSrcHash->m_Source_map;
+			wxASSERT(KeyHashSrcMap.size() < 0xFFFFFFFF);
+			s_file.WriteUInt32((uint32_t)KeyHashSrcMap.size());
+
+			for (CKadSourcePtrList::iterator itSource = KeyHashSrcMap.begin(); itSource != KeyHashSrcMap.end(); ++itSource) {
+				Source* currSource = *itSource;
+				s_file.WriteUInt128(currSource->sourceID);
+
+				CKadEntryPtrList& SrcEntryList = currSource->entryList;
+				wxASSERT(SrcEntryList.size() < 0xFFFFFFFF);
+				s_file.WriteUInt32((uint32_t)SrcEntryList.size());
+				for (CKadEntryPtrList::iterator itEntry = SrcEntryList.begin(); itEntry != SrcEntryList.end(); ++itEntry) {
+					Kademlia::CEntry* currName = *itEntry;
+					s_file.WriteUInt32(currName->m_tLifeTime);
+					currName->WriteTagList(&s_file);
+					s_total++;
 				}
-				delete currSrcHash;
 			}
-			s_file.Close();
 		}
+		s_file.Close();
 
-		CFile k_file;
-		if (k_file.Open(m_kfilename, CFile::write)) {
-			k_file.WriteUInt32(3); // version
-			k_file.WriteUInt32(now + KADEMLIAREPUBLISHTIMEK);
-			k_file.WriteUInt128(Kademlia::CKademlia::GetPrefs()->GetKadID());
-
-			wxASSERT(m_Keyword_map.size() < 0xFFFFFFFF);
-			k_file.WriteUInt32((uint32_t)m_Keyword_map.size());
-
-			for (KeyHashMap::iterator itKeyHash = m_Keyword_map.begin(); itKeyHash != m_Keyword_map.end(); ++itKeyHash ) {
-				KeyHash* currKeyHash = itKeyHash->second;
-				k_file.WriteUInt128(currKeyHash->keyID);
-
-				CSourceKeyMap& KeyHashSrcMap = currKeyHash->m_Source_map;
-				wxASSERT(KeyHashSrcMap.size() < 0xFFFFFFFF);
-				k_file.WriteUInt32((uint32_t)KeyHashSrcMap.size());
-
-				for (CSourceKeyMap::iterator itSource = KeyHashSrcMap.begin(); itSource != KeyHashSrcMap.end(); ++itSource ) {
-					Source* currSource = itSource->second;
-					k_file.WriteUInt128(currSource->sourceID);
-
-					CKadEntryPtrList& SrcEntryList = currSource->entryList;
-					wxASSERT(SrcEntryList.size() < 0xFFFFFFFF);
-					k_file.WriteUInt32((uint32_t)SrcEntryList.size());
-
-					for (CKadEntryPtrList::iterator itEntry = SrcEntryList.begin(); itEntry != SrcEntryList.end(); ++itEntry) {
-						Kademlia::CKeyEntry* currName = static_cast<Kademlia::CKeyEntry*>(*itEntry);
-						wxASSERT(currName->IsKeyEntry());
-						k_file.WriteUInt32(currName->m_tLifeTime);
-						currName->WritePublishTrackingDataToFile(&k_file);
-						currName->WriteTagList(&k_file);
-						currName->DirtyDeletePublishData();
-						delete currName;
-						k_total++;
-					}
-					delete currSource;
-				}
-				CKeyEntry::ResetGlobalTrackingMap();
-				delete currKeyHash;
-			}
-			k_file.Close();
-		}
-		AddDebugLogLineN(logKadIndex, CFormat(wxT("Wrote %u source, %u keyword, and %u load entries")) % s_total % k_total % l_total);
+		CIndexFileWriter k_file(m_kfilename);
+		k_file.WriteUInt32(3); // version
+		k_file.WriteUInt32(now + KADEMLIAREPUBLISHTIMEK);
+		k_file.WriteUInt128(Kademlia::CKademlia::GetPrefs()->GetKadID());
+
+		wxASSERT(m_Keyword_map.size() < 0xFFFFFFFF);
+		k_file.WriteUInt32((uint32_t)m_Keyword_map.size());
+
+		for (KeyHashMap::iterator itKeyHash = m_Keyword_map.begin(); itKeyHash != m_Keyword_map.end(); ++itKeyHash ) {
+			KeyHash* currKeyHash = itKeyHash->second;
+			k_file.WriteUInt128(currKeyHash->keyID);
 
-		for (SrcHashMap::iterator itNoteHash = m_Notes_map.begin(); itNoteHash != m_Notes_map.end(); ++itNoteHash) {
-			SrcHash* currNoteHash = itNoteHash->second;
-			CKadSourcePtrList& KeyHashNoteMap = currNoteHash->m_Source_map;
+			CSourceKeyMap& KeyHashSrcMap = currKeyHash->m_Source_map;
+			wxASSERT(KeyHashSrcMap.size() < 0xFFFFFFFF);
+			k_file.WriteUInt32((uint32_t)KeyHashSrcMap.size());
 
-			for (CKadSourcePtrList::iterator itNote = KeyHashNoteMap.begin(); itNote != KeyHashNoteMap.end(); ++itNote) {
-				Source* currNote = *itNote;
-				CKadEntryPtrList& NoteEntryList = currNote->entryList;
-				for (CKadEntryPtrList::iterator itNoteEntry = NoteEntryList.begin(); itNoteEntry != NoteEntryList.end(); ++itNoteEntry) {
-					delete *itNoteEntry;
+			for (CSourceKeyMap::iterator itSource = KeyHashSrcMap.begin(); itSource != KeyHashSrcMap.end(); ++itSource ) {
+				Source* currSource = itSource->second;
+				k_file.WriteUInt128(currSource->sourceID);
+
+				CKadEntryPtrList& SrcEntryList = currSource->entryList;
+				wxASSERT(SrcEntryList.size() < 0xFFFFFFFF);
+				k_file.WriteUInt32((uint32_t)SrcEntryList.size());
+
+				for (CKadEntryPtrList::iterator itEntry = SrcEntryList.begin(); itEntry != SrcEntryList.end(); ++itEntry) {
+					Kademlia::CKeyEntry* currName = static_cast<Kademlia::CKeyEntry*>(*itEntry);
+					wxASSERT(currName->IsKeyEntry());
+					k_file.WriteUInt32(currName->m_tLifeTime);
+					currName->WritePublishTrackingDataToFile(&k_file);
+					currName->WriteTagList(&k_file);
+					k_total++;
 				}
-				delete currNote;
 			}
-			delete currNoteHash;
 		}
+		k_file.Close();
 
-		m_Notes_map.clear();
+		AddDebugLogLineN(logKadIndex, CFormat(wxT("Wrote %u source, %u keyword, and %u load entries")) % s_total % k_total % l_total);
 	} catch (const CSafeIOException& err) {
-		AddDebugLogLineC(logKadIndex, wxT("CSafeIOException in CIndexed::~CIndexed: ") + err.what());
+		AddDebugLogLineC(logKadIndex, wxT("CSafeIOException in CIndexed::WriteFile: ") + err.what());
 	} catch (const CInvalidPacket& err) {
-		AddDebugLogLineC(logKadIndex, wxT("CInvalidPacket Exception in CIndexed::~CIndexed: ") + err.what());
+		AddDebugLogLineC(logKadIndex, wxT("CInvalidPacket Exception in CIndexed::WriteFile: ") + err.what());
 	} catch (const wxString& e) {
-		AddDebugLogLineC(logKadIndex, wxT("Exception in CIndexed::~CIndexed: ") + e);
+		AddDebugLogLineC(logKadIndex, wxT("Exception in CIndexed::WriteFile: ") + e);
 	}
 }
 
@@ -385,7 +510,7 @@ void CIndexed::Clean()
 
 	uint32_t k_Removed = 0;
 	uint32_t s_Removed = 0;
-	uint32_t s_Total = 0;
+	uint32_t s_Total = m_totalIndexSource;
 	uint32_t k_Total = 0;
 
 	KeyHashMap::iterator itKeyHash = m_Keyword_map.begin();
@@ -428,47 +553,72 @@ void CIndexed::Clean()
 		}
 	}
 
-	SrcHashMap::iterator itSrcHash = m_Sources_map.begin();
-	while (itSrcHash != m_Sources_map.end()) {
-		SrcHashMap::iterator curr_itSrcHash = itSrcHash++; // Don't change this to a ++it!
-		SrcHash* currSrcHash = curr_itSrcHash->second;
+	// Only the keys with entries in an expired slot need to be looked at
+	while (!m_sourceExpiry.empty() && (m_sourceExpiry.begin()->first + 1) * SOURCE_EXPIRY_SLOT <= tNow) {
+		const std::set<CUInt128>& keys = m_sourceExpiry.begin()->second;
+		for (std::set<CUInt128>::const_iterator itKey = keys.begin(); itKey != keys.end(); ++itKey) {
+			s_Removed += CleanSources(*itKey, tNow);
+		}
+		m_sourceExpiry.erase(m_sourceExpiry.begin());
+	}
 
-		CKadSourcePtrList::iterator itSource = currSrcHash->m_Source_map.begin();
-		while (itSource != currSrcHash->m_Source_map.end()) {
-			Source* currSource = *itSource;
+	m_totalIndexSource = s_Total - s_Removed;
+	m_totalIndexKeyword = k_Total - k_Removed;
+	AddDebugLogLineN(logKadIndex, CFormat(wxT("Removed %u keyword out of %u and %u source out of %u")) % k_Removed % k_Total % s_Removed % s_Total);
+	m_lastClean = tNow + MIN2S(30);
 
-			CKadEntryPtrList::iterator itEntry = currSource->entryList.begin();
-			while (itEntry != currSource->entryList.end()) {
-				s_Total++;
+	if (m_nextSave <= tNow) {
+		WriteFile();
+		m_nextSave = tNow + INDEX_SAVE_INTERVAL;
+	}
+}
 
-				Kademlia::CEntry* currName = *itEntry;
-				if (currName->m_tLifeTime < tNow) {
-					s_Removed++;
-					itEntry = currSource->entryList.erase(itEntry);
-					delete currName;
-				} else {
-					++itEntry;
-				}
-			}
+void CIndexed::AddSourceExpiry(const CUInt128& keyID, time_t lifeTime)
+{
+	m_sourceExpiry[lifeTime / SOURCE_EXPIRY_SLOT].insert(keyID);
+}
 
-			if (currSource->entryList.empty()) {
-				itSource = currSrcHash->m_Source_map.erase(itSource);
-				delete currSource;
+uint32_t CIndexed::CleanSources(const CUInt128& keyID, time_t now)
+{
+	// The key may be gone already, or its entries may have been republished
+	SrcHashMap::iterator itSrcHash = m_Sources_map.find(keyID);
+	if (itSrcHash == m_Sources_map.end()) {
+		return 0;
+	}
+
+	uint32_t removed = 0;
+	SrcHash* currSrcHash = itSrcHash->second;
+
+	CKadSourcePtrList::iterator itSource = currSrcHash->m_Source_map.begin();
+	while (itSource != currSrcHash->m_Source_map.end()) {
+		Source* currSource = *itSource;
+
+		CKadEntryPtrList::iterator itEntry = currSource->entryList.begin();
+		while (itEntry != currSource->entryList.end()) {
+			Kademlia::CEntry* currName = *itEntry;
+			if (currName->m_tLifeTime < now) {
+				removed++;
+				itEntry = currSource->entryList.erase(itEntry);
+				delete currName;
 			} else {
-				++itSource;
+				++itEntry;
 			}
 		}
 
-		if (currSrcHash->m_Source_map.empty()) {
-			m_Sources_map.erase(curr_itSrcHash);
-			delete currSrcHash;
+		if (currSource->entryList.empty()) {
+			itSource = currSrcHash->m_Source_map.erase(itSource);
+			delete currSource;
+		} else {
+			++itSource;
 		}
 	}
 
-	m_totalIndexSource = s_Total - s_Removed;
-	m_totalIndexKeyword = k_Total - k_Removed;
-	AddDebugLogLineN(logKadIndex, CFormat(wxT("Removed %u keyword out of %u and %u source out of %u")) % k_Removed % k_Total % s_Removed % s_Total);
-	m_lastClean = tNow + MIN2S(30);
+	if (currSrcHash->m_Source_map.empty()) {
+		m_Sources_map.erase(itSrcHash);
+		delete currSrcHash;
+	}
+
+	return removed;
 }
 
 bool CIndexed::AddKeyword(const CUInt128& keyID, const CUInt128& sourceID, Kademlia::CKeyEntry* entry, uint8_t& load)
@@ -570,6 +720,8 @@ bool CIndexed::AddSources(const CUInt128& keyID, const CUInt128& sourceID, Kadem
 		return false;
 	}
 
+	AddSourceExpiry(keyID, entry->m_tLifeTime);
+
 	SrcHash* currSrcHash = NULL;
 	SrcHashMap::iterator itSrcHash = m_Sources_map.find(keyID);
 	if (itSrcHash == m_Sources_map.end()) {
@@ -749,6 +901,8 @@ void CIndexed::SendValidKeywordResult(const CUInt128& keyID, const SSearchTerm*
 		// of spam entries. We could also sort by trustvalue, but we would risk to only send popular files this way
 		// on very hot keywords
 		bool onlyTrusted = true;
+		// Prepared once, as it gets matched against all entries of the keyword
+		CScopedPtr<CSearchTermProgram> program(pSearchTerms ? new CSearchTermProgram(pSearchTerms) : NULL);
 		DEBUG_ONLY( uint32_t dbgResultsTrusted = 0; )
 		DEBUG_ONLY( uint32_t dbgResultsUntrusted = 0; )
 
@@ -759,7 +913,7 @@ void CIndexed::SendValidKeywordResult(const CUInt128& keyID, const SSearchTerm*
 				for (CKadEntryPtrList::iterator itEntry = currSource->entryList.begin(); itEntry != currSource->entryList.end(); ++itEntry) {
 					Kademlia::CKeyEntry* currName = static_cast<Kademlia::CKeyEntry*>(*itEntry);
 					wxASSERT(currName->IsKeyEntry());
-					if ((onlyTrusted ^ (currName->GetTrustValue() < 1.0)) && (!pSearchTerms || currName->SearchTermsMatch(pSearchTerms))) {
+					if ((onlyTrusted ^ (currName->GetTrustValue() < 1.0)) && (!program.get() || currName->SearchTermsMatch(*program))) {
 						if (count < 0) {
 							count++;
 						} else if ((uint16_t)count < maxResults) {
@@ -924,6 +1078,73 @@ bool CIndexed::SendStoreRequest(const CUInt128& keyID)
 	return true;
 }
 
+CSearchTermProgram::CSearchTermProgram(const SSearchTerm* searchTerms)
+{
+	Compile(searchTerms);
+}
+
+void CSearchTermProgram::Compile(const SSearchTerm* searchTerm)
+{
+	wxCHECK_RET(searchTerm != NULL, wxT("Incomplete search expression"));
+
+	uint32_t index = m_instructions.size();
+	m_instructions.push_back(SInstruction());
+	{
+		// Filled in before the subtrees grow the vector
+		SInstruction& instruction = m_instructions.back();
+		instruction.type = searchTerm->type;
+		instruction.valueType = ValueNone;
+		instruction.intValue = 0;
+		instruction.floatValue = 0;
+
+		switch (searchTerm->type) {
+			case SSearchTerm::AND:
+			case SSearchTerm::OR:
+			case SSearchTerm::NOT:
+				break;
+
+			case SSearchTerm::String:
+				for (size_t i = 0; i < searchTerm->astr->GetCount(); i++) {
+					instruction.words.push_back((*searchTerm->astr)[i]);
+				}
+				break;
+
+			case SSearchTerm::MetaTag:
+				// meta tags with string values
+				if (searchTerm->tag->IsStr()) {
+					if (searchTerm->tag->GetName() == TAG_FILEFORMAT) {
+						instruction.valueType = ValueFileFormat;
+						instruction.strValue = searchTerm->tag->GetStr().Lower();
+					} else {
+						instruction.valueType = ValueString;
+						instruction.tagName = searchTerm->tag->GetName();
+						instruction.strValue = searchTerm->tag->GetStr();
+					}
+				}
+				break;
+
+			default:
+				// comparisons
+				instruction.tagName = searchTerm->tag->GetName();
+				if (searchTerm->tag->IsInt()) {
+					instruction.valueType = ValueInt;
+					instruction.intValue = searchTerm->tag->GetInt();
+				} else if (searchTerm->tag->IsFloat()) {
+					instruction.valueType = ValueFloat;
+					instruction.floatValue = searchTerm->tag->GetFloat();
+				}
+				break;
+		}
+	}
+
+	if (searchTerm->type == SSearchTerm::AND || searchTerm->type == SSearchTerm::OR || searchTerm->type == SSearchTerm::NOT) {
+		Compile(searchTerm->left);
+		Compile(searchTerm->right);
+	}
+
+	m_instructions[index].end = m_instructions.size();
+}
+
 SSearchTerm::SSearchTerm()
 	: type(AND),
 	  tag(NULL),
@@ -40,6 +40,9 @@ there client on the eMule forum..
 #define __INDEXED_H__
 
 
+#include <set>
+#include <vector>
+
 #include "SearchManager.h"
 #include "Entry.h"
 
@@ -105,6 +108,8 @@ struct SSearchTerm
 typedef std::map<Kademlia::CUInt128,KeyHash*> KeyHashMap;
 typedef std::map<Kademlia::CUInt128,SrcHash*> SrcHashMap;
 typedef std::map<Kademlia::CUInt128,Load*> LoadMap;
+// Keys of the source entries expiring in a time slot, by slot.
+typedef std::map<time_t, std::set<Kademlia::CUInt128> > ExpiryBucketMap;
 
 ////////////////////////////////////////
 namespace Kademlia {
@@ -112,11 +117,58 @@ namespace Kademlia {
 
 class CKadUDPKey;
 
+/**
+ * A search expression prepared for matching many index entries.
+ *
+ * The tree is stored in prefix order, and every node knows where its
+ * subtree ends, so an AND or OR that its left side decides can skip the
+ * right one. Tag names and values are taken out of the tags once, so
+ * matching an entry neither copies strings nor walks the tree.
+ */
+class CSearchTermProgram
+{
+public:
+	enum EValueType {
+		ValueNone,	//!< Matches nothing, like unsupported terms did before
+		ValueInt,
+		ValueFloat,
+		ValueString,
+		ValueFileFormat	//!< Compared with the extension of the file name
+	};
+
+	struct SInstruction {
+		SSearchTerm::ESearchTermType	type;
+		EValueType	valueType;
+		//! Index of the first instruction after this subtree.
+		uint32_t	end;
+		wxString	tagName;
+		wxString	strValue;
+		uint64_t	intValue;
+		float		floatValue;
+		//! Lower-case words of a String term, which all have to be found.
+		std::vector<wxString>	words;
+	};
+
+	explicit CSearchTermProgram(const SSearchTerm* searchTerms);
+
+	const SInstruction& operator[](uint32_t index) const	{ return m_instructions[index]; }
+
+private:
+	void Compile(const SSearchTerm* searchTerm);
+
+	std::vector<SInstruction> m_instructions;
+};
+
 class CIndexed
 {
 
 public:
-	CIndexed();
+	/**
+	 * @param directory The directory the index files are read from and saved
+	 *                  to. If it is empty, the index is kept in memory only,
+	 *                  like KadLookupBenchmark does.
+	 */
+	explicit CIndexed(const wxString& directory);
 	~CIndexed();
 
 	bool AddKeyword(const CUInt128& keyWordID, const CUInt128& sourceID, Kademlia::CKeyEntry* entry, uint8_t& load);
@@ -135,15 +187,20 @@ public:
 
 private:
 	time_t m_lastClean;
+	time_t m_nextSave;
 	KeyHashMap m_Keyword_map;
 	SrcHashMap m_Sources_map;
 	SrcHashMap m_Notes_map;
 	LoadMap m_Load_map;
-	static wxString m_sfilename;
-	static wxString m_kfilename;
-	static wxString m_loadfilename;
+	ExpiryBucketMap m_sourceExpiry;
+	wxString m_sfilename;
+	wxString m_kfilename;
+	wxString m_loadfilename;
 	void ReadFile();
+	void WriteFile();
 	void Clean();
+	void AddSourceExpiry(const CUInt128& keyID, time_t lifeTime);
+	uint32_t CleanSources(const CUInt128& keyID, time_t now);
 };
 
 } // End namespace
@@ -48,6 +48,7 @@ there client on the eMule forum..
 #include "../utils/KadClientSearcher.h"
 #include "../../amule.h"
 #include "../../Logger.h"
+#include "../../Preferences.h"
 #include <protocol/kad2/Client2Client/UDP.h>
 
 #ifdef _MSC_VER  // silly warnings about deprecated functions
@@ -118,7 +119,7 @@ void CKademlia::Start(CPrefs *prefs)
 	// Create our Kad objects.
 	instance = new CKademlia();
 	instance->m_prefs = prefs;
-	instance->m_indexed = new CIndexed();
+	instance->m_indexed = new CIndexed(thePrefs::GetConfigDir());
 	instance->m_routingZone = new CRoutingZone();
 	instance->m_udpListener = new CKademliaUDPListener();
 	// Mark Kad as running state.
@@ -0,0 +1,97 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "RequestTimeout.h" // Interface declarations
+
+#include <common/Macros.h>
+
+#include "Defines.h"
+
+#include <algorithm>
+
+////////////////////////////////////////
+using namespace Kademlia;
+////////////////////////////////////////
+
+// Bounds of the request timeout. The upper one is the delay lookups
+// always used to wait for before.
+static const uint32_t MIN_REQUEST_TIMEOUT = 500;
+static const uint32_t MAX_REQUEST_TIMEOUT = SEC2MS(3);
+// The response rate is smoothed with this weight of the last request
+static const uint32_t RESPONSE_RATE_WEIGHT = 16;
+
+CRequestTimeout::CRequestTimeout() throw()
+	: m_smoothedRTT(0),
+	  m_rttVariation(0),
+	  m_responseRate(1000),
+	  m_expired(0)
+{
+}
+
+void CRequestTimeout::AddRTT(uint32_t rtt) throw()
+{
+	// Smoothed like TCP does it (RFC 6298)
+	if (m_smoothedRTT == 0) {
+		m_smoothedRTT = rtt ? rtt : 1;
+		m_rttVariation = rtt / 2;
+	} else {
+		uint32_t deviation = rtt > m_smoothedRTT ? rtt - m_smoothedRTT : m_smoothedRTT - rtt;
+		m_rttVariation = (3 * m_rttVariation + deviation) / 4;
+		m_smoothedRTT = (7 * m_smoothedRTT + rtt) / 8;
+		if (m_smoothedRTT == 0) {
+			m_smoothedRTT = 1;
+		}
+	}
+}
+
+void CRequestTimeout::AddAnswered() throw()
+{
+	m_responseRate = (m_responseRate * (RESPONSE_RATE_WEIGHT - 1) + 1000) / RESPONSE_RATE_WEIGHT;
+}
+
+void CRequestTimeout::AddExpired() throw()
+{
+	m_expired++;
+	m_responseRate = m_responseRate * (RESPONSE_RATE_WEIGHT - 1) / RESPONSE_RATE_WEIGHT;
+}
+
+uint32_t CRequestTimeout::GetTimeout() const throw()
+{
+	if (m_smoothedRTT == 0) {
+		return MAX_REQUEST_TIMEOUT;
+	}
+
+	uint32_t timeout = m_smoothedRTT + 4 * m_rttVariation;
+	return std::min(std::max(timeout, MIN_REQUEST_TIMEOUT), MAX_REQUEST_TIMEOUT);
+}
+
+uint32_t CRequestTimeout::GetParallelism() const throw()
+{
+	if (m_responseRate <= 500) {
+		return 2 * ALPHA_QUERY;
+	}
+
+	return (ALPHA_QUERY * 1000 + m_responseRate - 1) / m_responseRate;
+}
+// File_checked_for_headers
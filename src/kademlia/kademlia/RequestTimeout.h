@@ -0,0 +1,91 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef __KAD_REQUESTTIMEOUT_H__
+#define __KAD_REQUESTTIMEOUT_H__
+
+#include "../../Types.h"
+
+////////////////////////////////////////
+namespace Kademlia {
+////////////////////////////////////////
+
+/**
+ * Round trip times and answers of the lookup requests.
+ *
+ * They decide how long a lookup waits for an answer before it asks the
+ * next contact, and how many requests it keeps in flight. The lookups
+ * share one instance, owned by CSearchManager; it does not depend on the
+ * rest of Kad, so KadLookupBenchmark can run the same estimator.
+ */
+class CRequestTimeout
+{
+public:
+	CRequestTimeout() throw();
+
+	/**
+	 * Adds the round trip time of an answered request, in milliseconds.
+	 * Late answers count too, so the timeout can grow again.
+	 */
+	void	 AddRTT(uint32_t rtt) throw();
+
+	/** Counts a request answered within the timeout. */
+	void	 AddAnswered() throw();
+
+	/** Counts a request that timed out. */
+	void	 AddExpired() throw();
+
+	/**
+	 * Milliseconds a request is waited for, between 500 ms and 3 s.
+	 * It is 3 s, the delay lookups always waited for before, until the
+	 * first answer came in.
+	 */
+	uint32_t GetTimeout() const throw();
+
+	/**
+	 * Share of the requests answered within the timeout, in per mille,
+	 * smoothed over the last few dozen requests.
+	 */
+	uint32_t GetResponseRate() const throw()	{ return m_responseRate; }
+
+	/**
+	 * Number of requests a lookup keeps in flight. It is ALPHA_QUERY divided
+	 * by the response rate, so that about ALPHA_QUERY of them are answered,
+	 * and at most twice ALPHA_QUERY.
+	 */
+	uint32_t GetParallelism() const throw();
+
+	uint64_t GetExpired() const throw()		{ return m_expired; }
+
+private:
+	uint32_t	m_smoothedRTT;
+	uint32_t	m_rttVariation;
+	uint32_t	m_responseRate;
+	uint64_t	m_expired;
+};
+
+} // End namespace
+
+#endif // __KAD_REQUESTTIMEOUT_H__
+// File_checked_for_headers
@@ -62,6 +62,8 @@ there client on the eMule forum..
 #include "../../Logger.h"
 #include "../../Preferences.h"
 #include "../../GuiEvents.h"
+#include "../../GetTickCount.h"
+#include "../../OtherFunctions.h"	// Needed for DeleteContents
 
 ////////////////////////////////////////
 using namespace Kademlia;
@@ -78,6 +80,10 @@ CSearch::CSearch()
 	m_totalLoad = 0;
 	m_totalLoadResponses = 0;
 	m_lastResponse = m_created;
+	m_createdTick = ::GetTickCount();
+	m_firstResultTick = 0;
+	m_convergedTick = 0;
+	m_keywordPacketsBuilt = false;
 	m_searchTermsData = NULL;
 	m_searchTermsDataSize = 0;
 	m_nodeSpecialSearchRequester = NULL;
@@ -101,6 +107,8 @@ CSearch::~CSearch()
 			if (m_closestDistantFound != 0) {
 				CKademlia::StatsAddClosestDistance(m_closestDistantFound);
 			}
+			CSearchManager::AddLookupTimes(m_firstResultTick ? m_firstResultTick - m_createdTick : 0,
+						       m_convergedTick ? m_convergedTick - m_createdTick : 0);
 			break;
 		default: // NODE, NODESPECIAL, NODEFWCHECKUDP, FINDBUDDY
 			break;
@@ -144,6 +152,8 @@ CSearch::~CSearch()
 		delete [] m_searchTermsData;
 	}
 
+	DeleteContents(m_keywordPackets);
+
 	switch (m_type) {
 		case KEYWORD:
 			Notify_KadSearchEnd(m_searchID);
@@ -235,8 +245,82 @@ void CSearch::PrepareToStop() throw()
 	m_stopping = true;
 }
 
+/**
+ * Gives up the requests that went unanswered for longer than the current
+ * request timeout, so their slots can be given to other contacts. Their
+ * send time is kept, so a late answer still counts for the round trip time.
+ *
+ * @return The number of requests still waiting for an answer.
+ */
+uint32_t CSearch::ExpireRequests()
+{
+	const uint32_t now = ::GetTickCount();
+	const uint32_t timeout = CSearchManager::GetRequestTimeout();
+
+	RequestTimeMap::iterator it = m_pending.begin();
+	while (it != m_pending.end()) {
+		if (now - it->second >= timeout) {
+			CSearchManager::AddExpiredRequest();
+			m_expired.insert(*it);
+			m_pending.erase(it++);
+		} else {
+			++it;
+		}
+	}
+
+	return m_pending.size();
+}
+
+/**
+ * Gives the slots of the timed out requests to the closest contacts not
+ * tried yet, until as many are in flight as CSearchManager::GetParallelism()
+ * allows. Once ALPHA_QUERY contacts answered, only contacts closer than
+ * them are asked, like ProcessResponse() does, so the farther contacts
+ * collected on the way are never queried this way.
+ */
+void CSearch::FillRequests()
+{
+	if (m_stopping) {
+		return;
+	}
+
+	ExpireRequests();
+
+	// Node lookups are started with a single request on purpose
+	if (m_type == NODE || m_type == NODEFWCHECKUDP) {
+		return;
+	}
+
+	const CUInt128* closerThan = NULL;
+	if (m_responded.size() >= ALPHA_QUERY) {
+		RespondedMap::const_iterator responder = m_responded.begin();
+		for (int i = 1; i < ALPHA_QUERY; i++) {
+			++responder;
+		}
+		closerThan = &responder->first;
+	}
+
+	const uint32_t parallelism = CSearchManager::GetParallelism();
+	ContactMap::iterator it = m_possible.begin();
+	while (it != m_possible.end() && m_pending.size() < parallelism) {
+		if (closerThan != NULL && !(it->first < *closerThan)) {
+			break;
+		}
+		if (m_tried.count(it->first) == 0) {
+			// Add to tried list.
+			m_tried[it->first] = it->second;
+			// Send request
+			SendFindValue(it->second);
+		}
+		++it;
+	}
+}
+
 void CSearch::JumpStart()
 {
+	// Replace the requests that timed out
+	FillRequests();
+
 	// If we had a response within the last 3 seconds, no need to jumpstart the search.
 	if ((time_t)(m_lastResponse + SEC(3)) > time(NULL)) {
 		return;
@@ -324,6 +408,22 @@ void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *r
 		}
 	}
 
+	if (fromContact != NULL) {
+		RequestTimeMap::iterator pending = m_pending.find(fromDistance);
+		if (pending != m_pending.end()) {
+			CSearchManager::AddRequestRTT(::GetTickCount() - pending->second);
+			CSearchManager::AddAnsweredRequest();
+			m_pending.erase(pending);
+		} else {
+			// An answer after the timeout still tells how long answers take
+			pending = m_expired.find(fromDistance);
+			if (pending != m_expired.end()) {
+				CSearchManager::AddRequestRTT(::GetTickCount() - pending->second);
+				m_expired.erase(pending);
+			}
+		}
+	}
+
 	// Make sure the node is not sending more results than we requested, which is not only a protocol violation
 	// but most likely a malicious answer
 	if (results->size() > GetRequestContactCount() && !(m_requestedMoreNodesContact == fromContact && results->size() <= KADEMLIA_FIND_VALUE_MORE)) {
@@ -430,12 +530,18 @@ void CSearch::ProcessResponse(uint32_t fromIP, uint16_t fromPort, ContactList *r
 
 		// Add to list of people who responded.
 		m_responded[fromDistance] = providedCloserContacts;
+		if (providedCloserContacts) {
+			m_convergedTick = ::GetTickCount();
+		}
 
 		// Complete node search, just increment the counter.
 		if (m_type == NODECOMPLETE || m_type == NODESPECIAL) {
 			AddDebugLogLineN(logKadSearch, wxString(wxT("Search result type: Node")) + (m_type == NODECOMPLETE ? wxT("Complete") : wxT("Special")));
 			m_answers++;
 		}
+
+		// The answer freed a slot, give it to the next closest contact
+		FillRequests();
 	}
 }
 
@@ -661,40 +767,14 @@ void CSearch::StorePacket()
 				break;
 			}
 
-			uint16_t count = m_fileIDs.size();
-			if (count == 0) {
+			BuildKeywordPackets();
+			if (m_keywordPackets.empty()) {
 				PrepareToStop();
 				break;
-			} else if (count > 150) {
-				count = 150;
 			}
 
-			UIntList::const_iterator itListFileID = m_fileIDs.begin();
-			uint8_t fileid[16];
-
-			while (count && (itListFileID != m_fileIDs.end())) {
-				uint16_t packetCount = 0;
-				CMemFile packetdata(1024*50); // Allocate a good amount of space.
-				packetdata.WriteUInt128(m_target);
-				packetdata.WriteUInt16(0); // Will be updated before sending.
-				while ((packetCount < 50) && (itListFileID != m_fileIDs.end())) {
-					CUInt128 id(*itListFileID);
-					id.ToByteArray(fileid);
-					CKnownFile *pFile = theApp->sharedfiles->GetFileByID(CMD4Hash(fileid));
-					if (pFile) {
-						count--;
-						packetCount++;
-						packetdata.WriteUInt128(id);
-						PreparePacketForTags(&packetdata, pFile);
-					}
-					++itListFileID;
-				}
-
-				// Correct file count.
-				uint64_t current_pos = packetdata.GetPosition();
-				packetdata.Seek(16);
-				packetdata.WriteUInt16(packetCount);
-				packetdata.Seek(current_pos);
+			for (PacketList::const_iterator it = m_keywordPackets.begin(); it != m_keywordPackets.end(); ++it) {
+				const CMemFile& packetdata = **it;
 
 				// Send packet
 				if (from->GetVersion() >= 6) {
@@ -845,6 +925,10 @@ void CSearch::StorePacket()
 
 void CSearch::ProcessResult(const CUInt128& answer, TagPtrList *info)
 {
+	if (m_firstResultTick == 0) {
+		m_firstResultTick = ::GetTickCount();
+	}
+
 	wxString type = wxT("Unknown");
 	switch (m_type) {
 		case FILE:
@@ -1125,6 +1209,7 @@ void CSearch::SendFindValue(CContact *contact, bool reaskMore)
 				CKademlia::GetUDPListener()->SendPacket(packetdata, KADEMLIA2_REQ, contact->GetIPAddress(), contact->GetUDPPort(), 0, NULL);
 				wxASSERT(contact->GetUDPKey() == CKadUDPKey(0));
 			}
+			m_pending[contact->GetClientID() ^ m_target] = ::GetTickCount();
 #ifdef __DEBUG__
 			switch (m_type) {
 				case NODE:
@@ -1174,6 +1259,54 @@ void CSearch::SendFindValue(CContact *contact, bool reaskMore)
 	}
 }
 
+/**
+ * Serializes the files to publish under our keyword, up to 150 of them in
+ * packets of 50 files each.
+ */
+void CSearch::BuildKeywordPackets()
+{
+	if (m_keywordPacketsBuilt) {
+		return;
+	}
+	m_keywordPacketsBuilt = true;
+
+	uint16_t count = m_fileIDs.size() > 150 ? 150 : m_fileIDs.size();
+	UIntList::const_iterator itListFileID = m_fileIDs.begin();
+	uint8_t fileid[16];
+
+	while (count && (itListFileID != m_fileIDs.end())) {
+		uint16_t packetCount = 0;
+		CMemFile *packetdata = new CMemFile(1024*50); // Allocate a good amount of space.
+		packetdata->WriteUInt128(m_target);
+		packetdata->WriteUInt16(0); // Will be updated when complete.
+		while ((packetCount < 50) && (itListFileID != m_fileIDs.end())) {
+			CUInt128 id(*itListFileID);
+			id.ToByteArray(fileid);
+			CKnownFile *pFile = theApp->sharedfiles->GetFileByID(CMD4Hash(fileid));
+			if (pFile) {
+				count--;
+				packetCount++;
+				packetdata->WriteUInt128(id);
+				PreparePacketForTags(packetdata, pFile);
+			}
+			++itListFileID;
+		}
+
+		if (packetCount == 0) {
+			delete packetdata;
+			break;
+		}
+
+		// Correct file count.
+		uint64_t current_pos = packetdata->GetPosition();
+		packetdata->Seek(16);
+		packetdata->WriteUInt16(packetCount);
+		packetdata->Seek(current_pos);
+
+		m_keywordPackets.push_back(packetdata);
+	}
+}
+
 // TODO: Redundant metadata checks
 void CSearch::PreparePacketForTags(CMemFile *bio, CKnownFile *file)
 {
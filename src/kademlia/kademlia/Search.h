@@ -109,8 +109,11 @@ private:
 	void ProcessResultNotes(const CUInt128 &answer, TagPtrList *info);
 	void JumpStart();
 	void SendFindValue(CContact *contact, bool reaskMore = false);
+	uint32_t ExpireRequests();
+	void FillRequests();
 	void PrepareToStop() throw();
 	void StorePacket();
+	void BuildKeywordPackets();
 
 	uint8_t	GetRequestContactCount() const;
 
@@ -122,6 +125,10 @@ private:
 	uint32_t	m_totalLoad;
 	uint32_t	m_totalLoadResponses;
 	uint32_t	m_lastResponse;
+	// Ticks of the start, the first result and the last closer contacts, for the statistics
+	uint32_t	m_createdTick;
+	uint32_t	m_firstResultTick;
+	uint32_t	m_convergedTick;
 
 	uint32_t	m_searchID;
 	CUInt128	m_target;
@@ -130,13 +137,21 @@ private:
 	WordList	m_words;  // list of words in the search string (populated in CSearchManager::PrepareFindKeywords)
 	wxString	m_fileName;
 	UIntList	m_fileIDs;
+	// The payloads of the keyword publish packets. They are the same for
+	// every node we store to, so they are built only once.
+	typedef std::vector<CMemFile*>	PacketList;
+	PacketList	m_keywordPackets;
+	bool		m_keywordPacketsBuilt;
 	CKadClientSearcher *m_nodeSpecialSearchRequester; // used to callback result for NODESPECIAL searches
 
 	typedef std::map<CUInt128, bool>	RespondedMap;
+	typedef std::map<CUInt128, uint32_t>	RequestTimeMap;
 
 	ContactMap	m_possible;
 	ContactMap	m_tried;
 	RespondedMap	m_responded;
+	RequestTimeMap	m_pending;	// requests not answered yet, with the tick they were sent
+	RequestTimeMap	m_expired;	// requests given up on, kept for late answers
 	ContactMap	m_best;
 	ContactList	m_delete;
 	ContactMap	m_inUse;
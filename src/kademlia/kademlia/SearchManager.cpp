@@ -52,6 +52,9 @@ there client on the eMule forum..
 
 #include <wx/tokenzr.h>
 
+#include <algorithm>
+#include <vector>
+
 ////////////////////////////////////////
 using namespace Kademlia;
 ////////////////////////////////////////
@@ -59,6 +62,13 @@ using namespace Kademlia;
 uint32_t  CSearchManager::m_nextID = 0;
 SearchMap CSearchManager::m_searches;
 
+CRequestTimeout			CSearchManager::m_requestTimeout;
+CSearchManager::LookupTimes	CSearchManager::m_firstResultTimes;
+CSearchManager::LookupTimes	CSearchManager::m_convergedTimes;
+
+// Number of finished lookups the percentiles are taken from
+static const size_t MAX_LOOKUP_TIMES = 100;
+
 bool CSearchManager::IsSearching(uint32_t searchID) throw()
 {
 	// Check if this searchID is within the searches
@@ -395,6 +405,43 @@ void CSearchManager::JumpStart()
 	}
 }
 
+void CSearchManager::ExpireRequests()
+{
+	for (SearchMap::iterator it = m_searches.begin(); it != m_searches.end(); ++it) {
+		it->second->FillRequests();
+	}
+}
+
+void CSearchManager::AddLookupTimes(uint32_t firstResult, uint32_t converged)
+{
+	if (firstResult) {
+		AddLookupTime(m_firstResultTimes, firstResult);
+	}
+	if (converged) {
+		AddLookupTime(m_convergedTimes, converged);
+	}
+}
+
+void CSearchManager::AddLookupTime(LookupTimes& times, uint32_t time)
+{
+	times.push_back(time);
+	if (times.size() > MAX_LOOKUP_TIMES) {
+		times.pop_front();
+	}
+}
+
+uint32_t CSearchManager::GetPercentile(const LookupTimes& times, unsigned percent)
+{
+	if (times.empty()) {
+		return 0;
+	}
+
+	std::vector<uint32_t> sorted(times.begin(), times.end());
+	std::vector<uint32_t>::iterator nth = sorted.begin() + (sorted.size() - 1) * percent / 100;
+	std::nth_element(sorted.begin(), nth, sorted.end());
+	return *nth;
+}
+
 void CSearchManager::UpdateStats() throw()
 {
 	uint8_t m_totalFile = 0;
@@ -42,6 +42,9 @@ there client on the eMule forum..
 #include "../utils/UInt128.h"
 #include "../routing/Maps.h"
 #include "../../Tag.h"
+#include "RequestTimeout.h"
+
+#include <deque>
 
 class CMemFile;
 
@@ -93,6 +96,35 @@ public:
 	static bool IsFWCheckUDPSearch(const CUInt128& target);
 	static void SetNextSearchID(uint32_t nextID) throw()	{ m_nextID = nextID; }
 
+	/**
+	 * Round trip times and answers of the lookup requests, see
+	 * CRequestTimeout. They decide how long a lookup waits for an answer
+	 * and how many requests it keeps in flight.
+	 */
+	static void	AddRequestRTT(uint32_t rtt) throw()	{ m_requestTimeout.AddRTT(rtt); }
+	static void	AddAnsweredRequest() throw()		{ m_requestTimeout.AddAnswered(); }
+	static void	AddExpiredRequest() throw()		{ m_requestTimeout.AddExpired(); }
+	static uint32_t	GetRequestTimeout() throw()		{ return m_requestTimeout.GetTimeout(); }
+	static uint64_t	GetExpiredRequests() throw()		{ return m_requestTimeout.GetExpired(); }
+	static uint32_t	GetResponseRate() throw()		{ return m_requestTimeout.GetResponseRate(); }
+	static uint32_t	GetParallelism() throw()		{ return m_requestTimeout.GetParallelism(); }
+
+	/**
+	 * Gives the slots of the timed out requests of all lookups to other
+	 * contacts. Called more often than JumpStart(), so timeouts below a
+	 * second take effect.
+	 */
+	static void	ExpireRequests();
+
+	/**
+	 * Durations of finished lookups, in milliseconds: until the first result
+	 * came in, and until the last answer with closer contacts. Zero means the
+	 * lookup never got there.
+	 */
+	static void	AddLookupTimes(uint32_t firstResult, uint32_t converged);
+	static uint32_t	GetFirstResultPercentile(unsigned percent)	{ return GetPercentile(m_firstResultTimes, percent); }
+	static uint32_t	GetConvergedPercentile(unsigned percent)	{ return GetPercentile(m_convergedTimes, percent); }
+
 private:
 
 	static void FindNode(const CUInt128& id, bool complete);
@@ -101,8 +133,16 @@ private:
 
 	static void JumpStart();
 
+	typedef std::deque<uint32_t> LookupTimes;
+	static void	AddLookupTime(LookupTimes& times, uint32_t time);
+	static uint32_t	GetPercentile(const LookupTimes& times, unsigned percent);
+
 	static uint32_t  m_nextID;
 	static SearchMap m_searches;
+
+	static CRequestTimeout	m_requestTimeout;
+	static LookupTimes	m_firstResultTimes;
+	static LookupTimes	m_convergedTimes;
 };
 
 } // End namespace
@@ -0,0 +1,163 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#include "KadPacketStats.h"
+
+#include <protocol/kad/Client2Client/UDP.h>
+#include <protocol/kad2/Client2Client/UDP.h>
+#include <common/Format.h>
+#include <common/Macros.h>
+
+#include "../../GetTickCount.h"
+#include "../../OtherFunctions.h"	// Needed for CastItoXBytes
+
+
+using namespace Kademlia;
+
+
+CKadPacketStats::OpcodeStats	CKadPacketStats::s_stats[256];
+uint32_t			CKadPacketStats::s_recent[256][RATE_SLOTS];
+uint32_t			CKadPacketStats::s_rateSlot = 0;
+
+
+CKadPacketStats::CProcessingTimer::CProcessingTimer(uint8_t opcode)
+	: m_opcode(opcode), m_start(GetTickCountMicro())
+{
+}
+
+
+CKadPacketStats::CProcessingTimer::~CProcessingTimer()
+{
+	// The Unix clock is the wall clock, which can be set back
+	uint64_t now = GetTickCountMicro();
+	if (now > m_start) {
+		s_stats[m_opcode].processingTime += now - m_start;
+	}
+}
+
+
+void CKadPacketStats::AdvanceRateSlot()
+{
+	uint32_t slot = ::GetTickCount() / SEC2MS(RATE_SLOT_LENGTH);
+
+	// Clear the slots that passed since the last packet, at most all of them
+	for (unsigned i = 0; s_rateSlot != slot && i < RATE_SLOTS; ++i) {
+		++s_rateSlot;
+		for (unsigned opcode = 0; opcode < 256; ++opcode) {
+			s_recent[opcode][s_rateSlot % RATE_SLOTS] = 0;
+		}
+	}
+	s_rateSlot = slot;
+}
+
+
+void CKadPacketStats::AddIncoming(uint8_t opcode, uint32_t size)
+{
+	AdvanceRateSlot();
+	s_stats[opcode].packetsIn++;
+	s_stats[opcode].bytesIn += size;
+	s_recent[opcode][s_rateSlot % RATE_SLOTS]++;
+}
+
+
+void CKadPacketStats::AddOutgoing(uint8_t opcode, uint32_t size)
+{
+	AdvanceRateSlot();
+	s_stats[opcode].packetsOut++;
+	s_stats[opcode].bytesOut += size;
+	s_recent[opcode][s_rateSlot % RATE_SLOTS]++;
+}
+
+
+uint64_t CKadPacketStats::GetTotalDropped()
+{
+	uint64_t total = 0;
+	for (unsigned opcode = 0; opcode < 256; ++opcode) {
+		total += s_stats[opcode].dropped;
+	}
+
+	return total;
+}
+
+
+double CKadPacketStats::GetRate(uint8_t opcode)
+{
+	AdvanceRateSlot();
+
+	uint32_t packets = 0;
+	for (unsigned i = 0; i < RATE_SLOTS; ++i) {
+		packets += s_recent[opcode][i];
+	}
+
+	return (double)packets / (RATE_SLOTS * RATE_SLOT_LENGTH);
+}
+
+
+wxString CKadPacketStats::GetSummary(uint8_t opcode)
+{
+	const OpcodeStats& stats = s_stats[opcode];
+
+	return CFormat(wxT("in %llu (%s), out %llu (%s), %.2f/s, %.1f ms CPU, %llu dropped"))
+		% stats.packetsIn % CastItoXBytes(stats.bytesIn)
+		% stats.packetsOut % CastItoXBytes(stats.bytesOut)
+		% GetRate(opcode) % (stats.processingTime / 1000.0) % stats.dropped;
+}
+
+
+wxString CKadPacketStats::GetOpcodeName(uint8_t opcode)
+{
+	switch (opcode) {
+		case KADEMLIA2_BOOTSTRAP_REQ:		return wxT("Kad2BootstrapReq");
+		case KADEMLIA2_BOOTSTRAP_RES:		return wxT("Kad2BootstrapRes");
+		case KADEMLIA2_HELLO_REQ:		return wxT("Kad2HelloReq");
+		case KADEMLIA2_HELLO_RES:		return wxT("Kad2HelloRes");
+		case KADEMLIA2_HELLO_RES_ACK:		return wxT("Kad2HelloResAck");
+		case KADEMLIA2_REQ:			return wxT("Kad2Req");
+		case KADEMLIA2_RES:			return wxT("Kad2Res");
+		case KADEMLIA2_SEARCH_KEY_REQ:		return wxT("Kad2SearchKeyReq");
+		case KADEMLIA2_SEARCH_SOURCE_REQ:	return wxT("Kad2SearchSourceReq");
+		case KADEMLIA2_SEARCH_NOTES_REQ:	return wxT("Kad2SearchNotesReq");
+		case KADEMLIA2_SEARCH_RES:		return wxT("Kad2SearchRes");
+		case KADEMLIA2_PUBLISH_KEY_REQ:		return wxT("Kad2PublishKeyReq");
+		case KADEMLIA2_PUBLISH_SOURCE_REQ:	return wxT("Kad2PublishSourceReq");
+		case KADEMLIA2_PUBLISH_NOTES_REQ:	return wxT("Kad2PublishNotesReq");
+		case KADEMLIA2_PUBLISH_RES:		return wxT("Kad2PublishRes");
+		case KADEMLIA2_PUBLISH_RES_ACK:		return wxT("Kad2PublishResAck");
+		case KADEMLIA_FIREWALLED2_REQ:		return wxT("KadFirewalled2Req");
+		case KADEMLIA2_PING:			return wxT("Kad2Ping");
+		case KADEMLIA2_PONG:			return wxT("Kad2Pong");
+		case KADEMLIA2_FIREWALLUDP:		return wxT("Kad2FirewallUDP");
+		case KADEMLIA_SEARCH_RES:		return wxT("KadSearchRes");
+		case KADEMLIA_SEARCH_NOTES_RES:		return wxT("KadSearchNotesRes");
+		case KADEMLIA_PUBLISH_RES:		return wxT("KadPublishRes");
+		case KADEMLIA_FIREWALLED_REQ:		return wxT("KadFirewalledReq");
+		case KADEMLIA_FINDBUDDY_REQ:		return wxT("KadFindBuddyReq");
+		case KADEMLIA_CALLBACK_REQ:		return wxT("KadCallbackReq");
+		case KADEMLIA_FIREWALLED_RES:		return wxT("KadFirewalledRes");
+		case KADEMLIA_FIREWALLED_ACK_RES:	return wxT("KadFirewalledAck");
+		case KADEMLIA_FINDBUDDY_RES:		return wxT("KadFindBuddyRes");
+		default:				return CFormat(wxT("Opcode 0x%02x")) % (unsigned)opcode;
+	}
+}
+// File_checked_for_headers
@@ -0,0 +1,101 @@
+//
+// This file is part of the aMule Project.
+//
+// Copyright (c) 2011 aMule Team ( admin@amule.org / http://www.amule.org )
+//
+// Any parts of this program derived from the xMule, lMule or eMule project,
+// or contributed by third-party developers are copyrighted by their
+// respective authors.
+//
+// This program is free software; you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation; either version 2 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301, USA
+//
+
+#ifndef KADEMLIA_NET_KADPACKETSTATS_H
+#define KADEMLIA_NET_KADPACKETSTATS_H
+
+#include "../../Types.h"
+
+namespace Kademlia
+{
+
+/**
+ * Traffic and processing cost of the Kad packets, per opcode.
+ *
+ * Sizes are those of the unpacked Kad payload, without the packet header,
+ * so the incoming and outgoing bytes compare. The counters are only
+ * touched from the main thread.
+ */
+class CKadPacketStats
+{
+public:
+	struct OpcodeStats {
+		uint64_t	packetsIn;
+		uint64_t	bytesIn;
+		uint64_t	packetsOut;
+		uint64_t	bytesOut;
+		uint64_t	dropped;	// incoming packets dropped by the flood protection
+		uint64_t	processingTime;	// spent in the handler, in microseconds
+	};
+
+	/**
+	 * Measures the time spent handling an incoming packet, from its
+	 * construction to its destruction.
+	 */
+	class CProcessingTimer
+	{
+	public:
+		CProcessingTimer(uint8_t opcode);
+		~CProcessingTimer();
+
+	private:
+		uint8_t		m_opcode;
+		uint64_t	m_start;
+	};
+
+	static void	AddIncoming(uint8_t opcode, uint32_t size);
+	static void	AddOutgoing(uint8_t opcode, uint32_t size);
+	static void	AddDropped(uint8_t opcode)	{ s_stats[opcode].dropped++; }
+
+	static const OpcodeStats& GetStats(uint8_t opcode)	{ return s_stats[opcode]; }
+	static uint64_t	GetTotalDropped();
+
+	/**
+	 * Packets per second in both directions, over the last minute.
+	 */
+	static double	GetRate(uint8_t opcode);
+
+	static wxString	GetOpcodeName(uint8_t opcode);
+
+	/**
+	 * All counters of an opcode in one line, for the statistics tree.
+	 */
+	static wxString	GetSummary(uint8_t opcode);
+
+private:
+	static void	AdvanceRateSlot();
+
+	// The rate is counted in slots of RATE_SLOT_LENGTH seconds
+	static const unsigned RATE_SLOTS = 6;
+	static const unsigned RATE_SLOT_LENGTH = 10;
+
+	static OpcodeStats	s_stats[256];
+	static uint32_t		s_recent[256][RATE_SLOTS];
+	static uint32_t		s_rateSlot;
+};
+
+} // End namespace
+
+#endif // KADEMLIA_NET_KADPACKETSTATS_H
+// File_checked_for_headers
@@ -46,6 +46,7 @@ there client on the eMule forum..
 #include <common/Format.h>
 #include <tags/FileTags.h>
 
+#include "KadPacketStats.h"
 #include "../routing/Contact.h"
 #include "../routing/RoutingZone.h"
 #include "../kademlia/Indexed.h"
@@ -230,10 +231,13 @@ void CKademliaUDPListener::ProcessPacket(const uint8_t* data, uint32_t lenData,
 	const uint8_t *packetData = data + 2;
 	uint32_t lenPacket = lenData - 2;
 
+	CKadPacketStats::AddIncoming(opcode, lenPacket);
 	if (!InTrackListIsAllowedPacket(ip, opcode, validReceiverKey)) {
+		CKadPacketStats::AddDropped(opcode);
 		return;
 	}
 
+	CKadPacketStats::CProcessingTimer timer(opcode);
 	switch (opcode) {
 		case KADEMLIA2_BOOTSTRAP_REQ:
 			DebugRecv(Kad2BootstrapReq, ip, port);
@@ -1596,6 +1600,7 @@ void CKademliaUDPListener::SendPacket(const CMemFile &data, uint8_t opcode, uint
 		cryptKey = NULL;
 	}
 	theStats::AddUpOverheadKad(packet->GetPacketSize());
+	CKadPacketStats::AddOutgoing(opcode, (uint32_t)data.GetLength());
 	theApp->clientudp->SendPacket(packet, wxUINT32_SWAP_ALWAYS(destinationHost), destinationPort, true, cryptKey, true, targetKey.GetKeyValue(theApp->GetPublicIP(false)));
 }
 
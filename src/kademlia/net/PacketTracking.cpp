@@ -53,14 +53,29 @@ void CPacketTracking::AddTrackedOutPacket(uint32_t ip, uint8_t opcode)
 		return;
 	}
 	uint32_t now = ::GetTickCount();
-	TrackPackets_Struct track = { ip, now, opcode };
-	listTrackedRequests.push_front(track);
-	while (!listTrackedRequests.empty()) {
-		if (now - listTrackedRequests.back().inserted > SEC2MS(180)) {
-			listTrackedRequests.pop_back();
-		} else {
-			break;
+	ExpireTrackedRequests(now);
+	const uint64_t key = MakeTrackKey(ip, opcode);
+	m_mapTrackedRequests[key].push_back(now);
+	TrackExpiry_Struct expiry = { key, now };
+	m_trackedRequestsExpiry.push_back(expiry);
+}
+
+void CPacketTracking::ExpireTrackedRequests(uint32_t now)
+{
+	while (!m_trackedRequestsExpiry.empty() && now - m_trackedRequestsExpiry.front().inserted > SEC2MS(180)) {
+		const TrackExpiry_Struct& expiry = m_trackedRequestsExpiry.front();
+		TrackedPacketMap::iterator it = m_mapTrackedRequests.find(expiry.key);
+		if (it != m_mapTrackedRequests.end()) {
+			// The request may have been answered already
+			TrackedTimes& times = it->second;
+			while (!times.empty() && (int32_t)(times.front() - expiry.inserted) <= 0) {
+				times.pop_front();
+			}
+			if (times.empty()) {
+				m_mapTrackedRequests.erase(it);
+			}
 		}
+		m_trackedRequestsExpiry.pop_front();
 	}
 }
 
@@ -94,13 +109,17 @@ bool CPacketTracking::IsOnOutTrackList(uint32_t ip, uint8_t opcode, bool dontRem
 	}
 #endif
 	uint32_t now = ::GetTickCount();
-	for (TrackedPacketList::iterator it = listTrackedRequests.begin(); it != listTrackedRequests.end(); ++it) {
-		if (it->ip == ip && it->opcode == opcode && now - it->inserted < SEC2MS(180)) {
-			if (!dontRemove) {
-				listTrackedRequests.erase(it);
+	ExpireTrackedRequests(now);
+	TrackedPacketMap::iterator it = m_mapTrackedRequests.find(MakeTrackKey(ip, opcode));
+	// The newest request is the last one to time out
+	if (it != m_mapTrackedRequests.end() && now - it->second.back() < SEC2MS(180)) {
+		if (!dontRemove) {
+			it->second.pop_back();
+			if (it->second.empty()) {
+				m_mapTrackedRequests.erase(it);
 			}
-			return true;
 		}
+		return true;
 	}
 	return false;
 }
@@ -259,32 +278,57 @@ void CPacketTracking::InTrackListCleanup()
 void CPacketTracking::AddLegacyChallenge(const CUInt128& contactID, const CUInt128& challengeID, uint32_t ip, uint8_t opcode)
 {
 	uint32_t now = ::GetTickCount();
+	ExpireLegacyChallenges(now);
+	const uint64_t key = MakeTrackKey(ip, opcode);
 	TrackChallenge_Struct sTrack = { ip, now, opcode, contactID, challengeID };
-	listChallengeRequests.push_front(sTrack);
-	while (!listChallengeRequests.empty()) {
-		if (now - listChallengeRequests.back().inserted > SEC2MS(180)) {
-			AddDebugLogLineN(logKadPacketTracking, wxT("Challenge timed out, client not verified - ") + KadIPToString(listChallengeRequests.back().ip));
-			listChallengeRequests.pop_back();
-		} else {
-			break;
+	m_mapChallengeRequests[key].push_back(sTrack);
+	TrackExpiry_Struct expiry = { key, now };
+	m_challengeRequestsExpiry.push_back(expiry);
+}
+
+void CPacketTracking::ExpireLegacyChallenges(uint32_t now)
+{
+	while (!m_challengeRequestsExpiry.empty() && now - m_challengeRequestsExpiry.front().inserted > SEC2MS(180)) {
+		const TrackExpiry_Struct& expiry = m_challengeRequestsExpiry.front();
+		TrackChallengeMap::iterator it = m_mapChallengeRequests.find(expiry.key);
+		if (it != m_mapChallengeRequests.end()) {
+			// The challenge may have been answered already
+			TrackChallengeList& challenges = it->second;
+			while (!challenges.empty() && (int32_t)(challenges.front().inserted - expiry.inserted) <= 0) {
+				AddDebugLogLineN(logKadPacketTracking, wxT("Challenge timed out, client not verified - ") + KadIPToString(challenges.front().ip));
+				challenges.pop_front();
+			}
+			if (challenges.empty()) {
+				m_mapChallengeRequests.erase(it);
+			}
 		}
+		m_challengeRequestsExpiry.pop_front();
 	}
 }
 
 bool CPacketTracking::IsLegacyChallenge(const CUInt128& challengeID, uint32_t ip, uint8_t opcode, CUInt128& contactID)
 {
 	uint32_t now = ::GetTickCount();
+	ExpireLegacyChallenges(now);
 	DEBUG_ONLY( bool warning = false; )
-	for (TrackChallengeList::iterator it = listChallengeRequests.begin(); it != listChallengeRequests.end();) {
-		TrackChallengeList::iterator it2 = it++;
-		if (it2->ip == ip && it2->opcode == opcode && now - it2->inserted < SEC2MS(180)) {
-			wxASSERT(it2->challenge != 0 || opcode == KADEMLIA2_PING);
-			if (it2->challenge == 0 || it2->challenge == challengeID) {
-				contactID = it2->contactID;
-				listChallengeRequests.erase(it2);
-				return true;
-			} else {
-				DEBUG_ONLY( warning = true; )
+	TrackChallengeMap::iterator entry = m_mapChallengeRequests.find(MakeTrackKey(ip, opcode));
+	if (entry != m_mapChallengeRequests.end()) {
+		TrackChallengeList& challenges = entry->second;
+		// Newest first
+		for (TrackChallengeList::iterator it = challenges.end(); it != challenges.begin();) {
+			--it;
+			if (now - it->inserted < SEC2MS(180)) {
+				wxASSERT(it->challenge != 0 || opcode == KADEMLIA2_PING);
+				if (it->challenge == 0 || it->challenge == challengeID) {
+					contactID = it->contactID;
+					challenges.erase(it);
+					if (challenges.empty()) {
+						m_mapChallengeRequests.erase(entry);
+					}
+					return true;
+				} else {
+					DEBUG_ONLY( warning = true; )
+				}
 			}
 		}
 	}
@@ -299,9 +343,13 @@ bool CPacketTracking::IsLegacyChallenge(const CUInt128& challengeID, uint32_t ip
 bool CPacketTracking::HasActiveLegacyChallenge(uint32_t ip) const
 {
 	uint32_t now = ::GetTickCount();
-	for (TrackChallengeList::const_iterator it = listChallengeRequests.begin(); it != listChallengeRequests.end(); ++it) {
-		if (it->ip == ip && now - it->inserted <= SEC2MS(180)) {
-			return true;
+	// The keys of all opcodes of an IP are next to each other
+	for (TrackChallengeMap::const_iterator it = m_mapChallengeRequests.lower_bound(MakeTrackKey(ip, 0));
+		it != m_mapChallengeRequests.end() && (it->first >> 8) == ip; ++it) {
+		for (TrackChallengeList::const_iterator it2 = it->second.begin(); it2 != it->second.end(); ++it2) {
+			if (now - it2->inserted <= SEC2MS(180)) {
+				return true;
+			}
 		}
 	}
 	return false;
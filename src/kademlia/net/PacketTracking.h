@@ -29,16 +29,16 @@
 
 #include <map>
 #include <list>
+#include <deque>
 #include "../utils/UInt128.h"
 #include "../../Types.h"
 
 namespace Kademlia
 {
 
-struct TrackPackets_Struct {
-	uint32_t ip;
+struct TrackExpiry_Struct {
+	uint64_t key;
 	uint32_t inserted;
-	uint8_t  opcode;
 };
 
 struct TrackChallenge_Struct {
@@ -86,11 +86,24 @@ class CPacketTracking
 
       private:
 	static bool IsTrackedOutListRequestPacket(uint8_t opcode) throw();
-	typedef std::list<TrackPackets_Struct>		TrackedPacketList;
-	typedef std::list<TrackChallenge_Struct>	TrackChallengeList;
+	static uint64_t MakeTrackKey(uint32_t ip, uint8_t opcode) throw() { return (uint64_t)ip << 8 | opcode; }
+	void ExpireTrackedRequests(uint32_t now);
+	void ExpireLegacyChallenges(uint32_t now);
+
+	// Outgoing requests are looked up by IP and opcode. For each key the
+	// times the requests were sent are kept, oldest first.
+	typedef std::deque<uint32_t>			TrackedTimes;
+	typedef std::map<uint64_t, TrackedTimes>	TrackedPacketMap;
+	typedef std::deque<TrackChallenge_Struct>	TrackChallengeList;
+	typedef std::map<uint64_t, TrackChallengeList>	TrackChallengeMap;
+	// All entries live for the same time, so they expire in the order they
+	// were added, and a queue is all it takes to find the expired ones.
+	typedef std::deque<TrackExpiry_Struct>		TrackExpiryQueue;
 	typedef std::map<uint32_t, TrackPacketsIn_Struct*>	TrackedPacketInMap;
-	TrackedPacketList	listTrackedRequests;
-	TrackChallengeList	listChallengeRequests;
+	TrackedPacketMap	m_mapTrackedRequests;
+	TrackExpiryQueue	m_trackedRequestsExpiry;
+	TrackChallengeMap	m_mapChallengeRequests;
+	TrackExpiryQueue	m_challengeRequestsExpiry;
 	TrackedPacketInMap	m_mapTrackPacketsIn;
 	uint32_t		lastTrackInCleanup;
 };
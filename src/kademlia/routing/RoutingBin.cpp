@@ -37,6 +37,9 @@ there client on the eMule forum..
 */
 
 #include "RoutingBin.h"
+
+#include <algorithm>
+
 #include "../../Logger.h"
 #include "../../NetworkFunctions.h"
 #include "../../RandomFunctions.h"
@@ -177,6 +180,15 @@ void CRoutingBin::GetEntries(ContactList *result, bool emptyFirst) const
 	}
 }
 
+namespace {
+	struct ContactDistance {
+		CUInt128	distance;
+		CContact*	contact;
+
+		bool operator<(const ContactDistance& other) const throw() { return distance < other.distance; }
+	};
+}
+
 void CRoutingBin::GetClosestTo(uint32_t maxType, const CUInt128 &target, uint32_t maxRequired, ContactMap *result, bool emptyFirst, bool inUse) const
 {
 	// Empty list if requested.
@@ -185,20 +197,32 @@ void CRoutingBin::GetClosestTo(uint32_t maxType, const CUInt128 &target, uint32_
 	}
 
 	// No entries, no closest.
-	if (m_entries.empty()) {
+	if (m_entries.empty() || maxRequired == 0) {
 		return;
 	}
 
-	// First put results in sort order for target so we can insert them correctly.
-	// We don't care about max results at this time.
-	for (ContactList::const_iterator it = m_entries.begin(); it != m_entries.end(); ++it) {
+	// A bin never holds more than K contacts, so they can be ranked in place
+	// and only the ones that are wanted go into the result map.
+	wxASSERT(m_entries.size() <= K);
+	ContactDistance candidates[K];
+	uint32_t count = 0;
+	for (ContactList::const_iterator it = m_entries.begin(); it != m_entries.end() && count < K; ++it) {
 		if ((*it)->GetType() <= maxType && (*it)->IsIPVerified()) {
-			CUInt128 targetDistance((*it)->GetClientID() ^ target);
-			(*result)[targetDistance] = *it;
-			// This list will be used for an unknown time, Inc in use so it's not deleted.
-			if (inUse) {
-				(*it)->IncUse();
-			}
+			candidates[count].distance = (*it)->GetClientID();
+			candidates[count].distance ^= target;
+			candidates[count].contact = *it;
+			++count;
+		}
+	}
+
+	uint32_t wanted = std::min(count, maxRequired);
+	std::partial_sort(candidates, candidates + wanted, candidates + count);
+
+	for (uint32_t i = 0; i < wanted; ++i) {
+		(*result)[candidates[i].distance] = candidates[i].contact;
+		// This list will be used for an unknown time, Inc in use so it's not deleted.
+		if (inUse) {
+			candidates[i].contact->IncUse();
 		}
 	}
 
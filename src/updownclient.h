@@ -171,6 +171,7 @@ public:
 	uint32		GetIP() const			{ return m_dwUserIP; }
 	bool		HasLowID() const		{ return IsLowID(m_nUserIDHybrid); }
 	wxString	GetFullIP() const		{ return Uint32toStringIP(m_FullUserIP); }
+	uint32		GetFullUserIP() const		{ return m_FullUserIP; }
 	uint32		GetConnectIP() const		{ return m_nConnectIP; }
 	uint32		GetUserIDHybrid() const		{ return m_nUserIDHybrid; }
 	void		SetUserIDHybrid(uint32 val);
@@ -458,11 +459,12 @@ public:
 	bool		SendPacket(CPacket* packet, bool delpacket = true, bool controlpacket = true);
 
 	/**
-	 * Safe function for setting the download limit of the socket.
+	 * Safe function for putting the socket under the control of the download throttler.
 	 *
+	 * @param priority Download priority of the file being downloaded.
 	 * @return Current download speed of the client.
 	 */
-	float		SetDownloadLimit(uint32 reducedownload);
+	float		SetDownloadPriority(uint8 priority);
 
 	/**
 	 * Sends a message to a client
@@ -0,0 +1,137 @@
+//
+// Compares the speed of the IP filter lookups with and without the
+// first level index of CIPFilterIndex.
+//
+// Usage: IPFilterBenchmark <ipfilter file> [number of lookups]
+//
+// The file may be in the PeerGuardian text format
+// ("description:1.2.3.4-1.2.3.255") or in the eMule ipfilter.dat format
+// ("1.2.3.4 - 1.2.3.255 , 100 , description"). Every range in the file is
+// blocked, regardless of its access level.
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+
+#include "Types.h"
+#include "RangeMap.h"
+#include "IPFilterIndex.h"
+
+
+static bool ParseIP(const char* str, uint32& ip, const char** end)
+{
+	unsigned a, b, c, d;
+	int length = 0;
+	if (sscanf(str, " %u.%u.%u.%u%n", &a, &b, &c, &d, &length) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+		return false;
+	}
+	ip = (a << 24) | (b << 16) | (c << 8) | d;
+	*end = str + length;
+	return true;
+}
+
+
+static bool ParseLine(const char* line, uint32& start, uint32& end)
+{
+	const char* pos;
+	if (!ParseIP(line, start, &pos)) {
+		// PeerGuardian lines start with the description
+		const char* colon = strrchr(line, ':');
+		if (!colon || !ParseIP(colon + 1, start, &pos)) {
+			return false;
+		}
+	}
+	while (*pos == ' ' || *pos == '\t') {
+		++pos;
+	}
+	if (*pos++ != '-') {
+		return false;
+	}
+	return ParseIP(pos, end, &pos) && start <= end;
+}
+
+
+// A simple xorshift generator, so all runs test the same addresses
+static uint32 NextRandom(uint32& state)
+{
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s <ipfilter file> [number of lookups]\n", argv[0]);
+		return 1;
+	}
+	uint32 lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 10000000;
+
+	FILE* file = fopen(argv[1], "r");
+	if (!file) {
+		fprintf(stderr, "Can't open %s\n", argv[1]);
+		return 1;
+	}
+
+	// Merge the ranges like the IP filter does
+	CRangeMap<void, uint32> ranges;
+	char line[1024];
+	uint32 lines = 0;
+	while (fgets(line, sizeof(line), file)) {
+		uint32 start, end;
+		if (ParseLine(line, start, end)) {
+			ranges.insert(start, end);
+			++lines;
+		}
+	}
+	fclose(file);
+
+	CIPFilterIndex::RangeIPs rangeIPs;
+	CIPFilterIndex::RangeLengths rangeLengths;
+	for (CRangeMap<void, uint32>::iterator it = ranges.begin(); it != ranges.end(); ++it) {
+		CIPFilterIndex::AppendRange(rangeIPs, rangeLengths, it.keyStart(), it.keyEnd());
+	}
+
+	clock_t buildStart = clock();
+	CIPFilterIndex index;
+	index.Build(rangeIPs);
+	double buildTime = (double)(clock() - buildStart) / CLOCKS_PER_SEC;
+
+	printf("%u ranges read, %u after merging, %u table entries, index built in %.3fs\n",
+		lines, (uint32)ranges.size(), (uint32)rangeIPs.size(), buildTime);
+
+	// Both searches must agree, check that first
+	uint32 state = 2463534242u;
+	for (uint32 i = 0; i < lookups / 10; ++i) {
+		uint32 ip = NextRandom(state);
+		if (index.Find(rangeIPs, rangeLengths, ip) != CIPFilterIndex::BinarySearch(rangeIPs, rangeLengths, ip)) {
+			fprintf(stderr, "Results differ for %08x\n", ip);
+			return 1;
+		}
+	}
+
+	uint32 hits = 0;
+	state = 2463534242u;
+	clock_t start = clock();
+	for (uint32 i = 0; i < lookups; ++i) {
+		hits += CIPFilterIndex::BinarySearch(rangeIPs, rangeLengths, NextRandom(state)) >= 0;
+	}
+	double binaryTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	state = 2463534242u;
+	start = clock();
+	for (uint32 i = 0; i < lookups; ++i) {
+		hits += index.Find(rangeIPs, rangeLengths, NextRandom(state)) >= 0;
+	}
+	double indexTime = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	printf("%u lookups, %u filtered\n", lookups, hits / 2);
+	printf("binary search: %.0f lookups/s\n", binaryTime > 0 ? lookups / binaryTime : 0.0);
+	printf("indexed:       %.0f lookups/s\n", indexTime > 0 ? lookups / indexTime : 0.0);
+
+	return 0;
+}
@@ -0,0 +1,110 @@
+#include <muleunit/test.h>
+#include "Types.h"
+#include "IPFilterIndex.h"
+
+using namespace muleunit;
+
+
+DECLARE(IPFilterIndex);
+	CIPFilterIndex::RangeIPs m_rangeIPs;
+	CIPFilterIndex::RangeLengths m_rangeLengths;
+	CIPFilterIndex m_index;
+
+	void setUp() {
+		// Ranges at the edges of the address space and of /16 networks,
+		// spanning several /16 networks, and several in a single one.
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0x00000000, 0x00000000);
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0x0000FFFF, 0x00010000);
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0x0A000000, 0x0A03FFFF);
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0x0B000010, 0x0B000020);
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0x0B000030, 0x0B000030);
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0x0B000100, 0x0B0123FF);
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0x7F000000, 0x8FFFFFFF);
+		CIPFilterIndex::AppendRange(m_rangeIPs, m_rangeLengths, 0xFFFFFFF0, 0xFFFFFFFF);
+		m_index.Build(m_rangeIPs);
+	}
+
+	// Checks that the index finds the same as the plain search, and returns it
+	int Find(uint32 ip) {
+		int result = m_index.Find(m_rangeIPs, m_rangeLengths, ip);
+		ASSERT_EQUALS(CIPFilterIndex::BinarySearch(m_rangeIPs, m_rangeLengths, ip), result);
+		return result;
+	}
+END_DECLARE;
+
+
+TEST(IPFilterIndex, AppendRange)
+{
+	CIPFilterIndex::RangeIPs ips;
+	CIPFilterIndex::RangeLengths lengths;
+
+	// Short ranges are stored as they are
+	ASSERT_EQUALS(1u, CIPFilterIndex::AppendRange(ips, lengths, 100, 100 + 0x7fff));
+	ASSERT_EQUALS(100u, ips[0]);
+	ASSERT_EQUALS(0x7fffu, CIPFilterIndex::DecodeLength(lengths[0]));
+
+	// Longer ones in multiples of 4096, the rest separately
+	ips.clear();
+	lengths.clear();
+	ASSERT_EQUALS(2u, CIPFilterIndex::AppendRange(ips, lengths, 0x10000, 0x10000 + 0x12344));
+	ASSERT_EQUALS(0x10000u, ips[0]);
+	ASSERT_EQUALS(0x11fffu, CIPFilterIndex::DecodeLength(lengths[0]));
+	ASSERT_EQUALS(0x22000u, ips[1]);
+	ASSERT_EQUALS(0x344u, CIPFilterIndex::DecodeLength(lengths[1]));
+
+	// The whole address space
+	ips.clear();
+	lengths.clear();
+	ASSERT_EQUALS(32u, CIPFilterIndex::AppendRange(ips, lengths, 0, 0xFFFFFFFF));
+	ASSERT_EQUALS(0xF8000000u, ips[31]);
+	ASSERT_EQUALS(0x07FFFFFFu, CIPFilterIndex::DecodeLength(lengths[31]));
+}
+
+
+TEST(IPFilterIndex, Find)
+{
+	ASSERT_EQUALS(0, Find(0x00000000));
+	ASSERT_EQUALS(-1, Find(0x00000001));
+	ASSERT_EQUALS(-1, Find(0x0000FFFE));
+	ASSERT_EQUALS(1, Find(0x0000FFFF));
+	ASSERT_EQUALS(1, Find(0x00010000));
+	ASSERT_EQUALS(-1, Find(0x00010001));
+	ASSERT_EQUALS(-1, Find(0x09FFFFFF));
+	ASSERT_EQUALS(2, Find(0x0A000000));
+	ASSERT_EQUALS(2, Find(0x0A02ABCD));
+	ASSERT_EQUALS(2, Find(0x0A03FFFF));
+	ASSERT_EQUALS(-1, Find(0x0A040000));
+	ASSERT_EQUALS(-1, Find(0x0B00000F));
+	ASSERT_EQUALS(3, Find(0x0B000010));
+	ASSERT_EQUALS(3, Find(0x0B000020));
+	ASSERT_EQUALS(-1, Find(0x0B00002F));
+	ASSERT_EQUALS(4, Find(0x0B000030));
+	ASSERT_EQUALS(-1, Find(0x0B000031));
+	ASSERT_EQUALS(-1, Find(0xFFFFFFEF));
+	ASSERT_EQUALS(-1, Find(0x90000000));
+	ASSERT_TRUE(Find(0x0B000100) >= 0);
+	ASSERT_TRUE(Find(0x0B0123FF) >= 0);
+	ASSERT_EQUALS(-1, Find(0x0B012400));
+	ASSERT_TRUE(Find(0x7F000000) >= 0);
+	ASSERT_TRUE(Find(0x8FFFFFFF) >= 0);
+	ASSERT_TRUE(Find(0xFFFFFFF0) >= 0);
+	ASSERT_TRUE(Find(0xFFFFFFFF) >= 0);
+
+	// Everything else must agree with the plain search, too
+	for (uint32 ip = 0x0AFF0000; ip < 0x0B020000; ip += 7) {
+		Find(ip);
+	}
+}
+
+
+TEST(IPFilterIndex, Empty)
+{
+	CIPFilterIndex::RangeIPs ips;
+	CIPFilterIndex::RangeLengths lengths;
+	CIPFilterIndex index;
+
+	ASSERT_EQUALS(-1, index.Find(ips, lengths, 0x01020304));
+	index.Build(ips);
+	ASSERT_EQUALS(-1, index.Find(ips, lengths, 0));
+	ASSERT_EQUALS(-1, index.Find(ips, lengths, 0xFFFFFFFF));
+}
@@ -0,0 +1,1003 @@
+//
+// Simulates a Kad network in one process and measures what lookups cost.
+//
+// Every node has a routing table that splits like CRoutingZone does, and
+// lookups follow CSearch: ALPHA_QUERY requests to start with, a request to
+// every answered contact that gets into the best ALPHA_QUERY, and a
+// jumpstart every SEARCH_JUMPSTART seconds when a lookup got no answer for
+// three seconds. Packets go through a simulated UDP transport with a
+// per-node latency and a loss rate.
+//
+// The lookups are run twice on the same network. The baseline lookups do
+// only the above, like CSearch did before requests timed out. The adaptive
+// lookups also replace the timed out requests every core timer tick with
+// closer contacts not tried yet, like CSearch::FillRequests(), waiting as
+// long and keeping as many requests in flight as CRequestTimeout, the
+// estimator CSearchManager uses, decides.
+//
+// Every node stores the sources published to it in a CIndexed, kept in
+// memory only, as KADEMLIA2_PUBLISH_SOURCE_REQ stores them. The memory the
+// indexes allocate is counted by replacing operator new.
+//
+// The benchmark first publishes a source for a number of random file
+// hashes, then looks them up from random nodes, and reports the hops and
+// time needed to reach the closest node, the time to the first result,
+// the packets sent, the CPU time per lookup and the size of the indexes,
+// for both kinds of lookups.
+//
+// Usage: KadLookupBenchmark [nodes] [lookups] [loss %] [dead %] [min latency ms] [max latency ms]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include <algorithm>
+#include <map>
+#include <new>
+#include <queue>
+#include <vector>
+
+#include "Types.h"
+#include <common/Macros.h>
+#include "kademlia/kademlia/Defines.h"
+#include "kademlia/kademlia/Entry.h"
+#include "kademlia/kademlia/Indexed.h"
+#include "kademlia/kademlia/Kademlia.h"
+#include "kademlia/kademlia/RequestTimeout.h"
+#include "kademlia/net/KademliaUDPListener.h"
+#include "kademlia/utils/KadUDPKey.h"
+#include "kademlia/utils/UInt128.h"
+#include "Tag.h"
+#include <protocol/kad/Constants.h>
+#include <tags/FileTags.h>
+
+using namespace Kademlia;
+
+
+// CIndexed reaches the running Kad instance only to save its files and to
+// answer searches, neither of which the benchmark does. These stand in for
+// the definitions in Kademlia.cpp and KademliaUDPListener.cpp.
+CKademlia* CKademlia::instance = NULL;
+
+void CKademliaUDPListener::SendPacket(const CMemFile&, uint8_t, uint32_t, uint16_t, const CKadUDPKey&, const CUInt128*)
+{
+	wxFAIL;
+}
+
+
+// Bytes and blocks allocated and not freed yet
+static uint64 s_allocatedBytes = 0;
+static uint64 s_allocatedBlocks = 0;
+
+// Keeps the size of a block in front of it, aligned like malloc() does
+union AllocationHeader
+{
+	size_t		size;
+	long double	alignDouble;
+	void*		alignPointer;
+};
+
+#if __cplusplus >= 201103L
+	#define OPERATOR_NEW_THROWS
+	#define OPERATOR_DELETE_THROWS	noexcept
+#else
+	#define OPERATOR_NEW_THROWS	throw(std::bad_alloc)
+	#define OPERATOR_DELETE_THROWS	throw()
+#endif
+
+// Once operator delete is inlined into the library's deallocation, GCC
+// wrongly warns that free() is given a block from operator new
+#ifdef __GNUC__
+	#define OPERATOR_DELETE_NOINLINE	__attribute__((__noinline__))
+#else
+	#define OPERATOR_DELETE_NOINLINE
+#endif
+
+void* operator new(size_t size) OPERATOR_NEW_THROWS
+{
+	AllocationHeader* header = static_cast<AllocationHeader*>(malloc(sizeof(AllocationHeader) + size));
+	if (header == NULL) {
+		throw std::bad_alloc();
+	}
+	header->size = size;
+	s_allocatedBytes += size;
+	++s_allocatedBlocks;
+	return header + 1;
+}
+
+void* operator new[](size_t size) OPERATOR_NEW_THROWS
+{
+	return operator new(size);
+}
+
+OPERATOR_DELETE_NOINLINE void operator delete(void* block) OPERATOR_DELETE_THROWS
+{
+	if (block != NULL) {
+		AllocationHeader* header = static_cast<AllocationHeader*>(block) - 1;
+		s_allocatedBytes -= header->size;
+		--s_allocatedBlocks;
+		free(header);
+	}
+}
+
+void operator delete[](void* block) OPERATOR_DELETE_THROWS
+{
+	operator delete(block);
+}
+
+#if __cplusplus >= 201402L
+void operator delete(void* block, size_t) noexcept
+{
+	operator delete(block);
+}
+
+void operator delete[](void* block, size_t) noexcept
+{
+	operator delete(block);
+}
+#endif
+
+
+// A simple xorshift generator, so all runs simulate the same network
+static uint32 s_randomState = 2463534242u;
+
+static uint32 NextRandom()
+{
+	s_randomState ^= s_randomState << 13;
+	s_randomState ^= s_randomState >> 17;
+	s_randomState ^= s_randomState << 5;
+	return s_randomState;
+}
+
+
+static uint32 NextRandom(uint32 min, uint32 max)
+{
+	return min + NextRandom() % (max - min + 1);
+}
+
+
+static CUInt128 RandomID()
+{
+	CUInt128 id;
+	for (unsigned i = 0; i < 4; ++i) {
+		id.Set32BitChunk(i, NextRandom());
+	}
+	return id;
+}
+
+
+// Contacts by their distance to some target, like Kademlia::ContactMap
+typedef std::map<CUInt128, uint32> SimContactMap;
+
+class CSimRoutingZone;
+
+
+struct SimNode
+{
+	CUInt128	id;
+	uint32		latency;	// one way, in ms
+	bool		dead;
+	CSimRoutingZone*	routing;
+	// number of sources published for each file hash, to answer searches
+	std::map<CUInt128, uint32> index;
+	// the published sources themselves
+	CIndexed*	indexed;
+	// memory allocated by indexed, see s_allocatedBytes
+	uint64		indexBytes;
+	uint64		indexBlocks;
+};
+
+typedef std::vector<SimNode> SimNodes;
+
+
+/**
+ * The routing table of one node. Splits and answers like CRoutingZone,
+ * without the contact management that needs a live network.
+ */
+class CSimRoutingZone
+{
+public:
+	CSimRoutingZone(const SimNodes& nodes, uint32 self)
+		: m_nodes(nodes), m_self(self), m_level(0), m_zoneIndex(0u)
+	{
+		m_subZones[0] = m_subZones[1] = NULL;
+	}
+
+	~CSimRoutingZone()
+	{
+		delete m_subZones[0];
+		delete m_subZones[1];
+	}
+
+	void Add(uint32 node)
+	{
+		CUInt128 distance(m_nodes[m_self].id ^ m_nodes[node].id);
+		if (node != m_self) {
+			Add(node, distance);
+		}
+	}
+
+	void GetClosestTo(const CUInt128& target, const CUInt128& distance, uint32 maxRequired, SimContactMap& result) const
+	{
+		if (IsLeaf()) {
+			for (std::vector<uint32>::const_iterator it = m_bin.begin(); it != m_bin.end(); ++it) {
+				result[m_nodes[*it].id ^ target] = *it;
+			}
+			while (result.size() > maxRequired) {
+				result.erase(--result.end());
+			}
+			return;
+		}
+
+		unsigned closer = distance.GetBitNumber(m_level);
+		m_subZones[closer]->GetClosestTo(target, distance, maxRequired, result);
+		if (result.size() < maxRequired) {
+			m_subZones[1 - closer]->GetClosestTo(target, distance, maxRequired, result);
+		}
+	}
+
+	uint32 GetNumContacts() const
+	{
+		return IsLeaf() ? m_bin.size() : m_subZones[0]->GetNumContacts() + m_subZones[1]->GetNumContacts();
+	}
+
+private:
+	CSimRoutingZone(const SimNodes& nodes, uint32 self, unsigned level, const CUInt128& zoneIndex)
+		: m_nodes(nodes), m_self(self), m_level(level), m_zoneIndex(zoneIndex)
+	{
+		m_subZones[0] = m_subZones[1] = NULL;
+	}
+
+	bool IsLeaf() const	{ return m_subZones[0] == NULL; }
+
+	bool CanSplit() const
+	{
+		return m_level < 127 && (m_zoneIndex < KK || m_level < KBASE) && m_bin.size() == K;
+	}
+
+	void Add(uint32 node, const CUInt128& distance)
+	{
+		if (!IsLeaf()) {
+			m_subZones[distance.GetBitNumber(m_level)]->Add(node, distance);
+		} else if (std::find(m_bin.begin(), m_bin.end(), node) != m_bin.end()) {
+			return;
+		} else if (m_bin.size() < K) {
+			m_bin.push_back(node);
+		} else if (CanSplit()) {
+			Split();
+			m_subZones[distance.GetBitNumber(m_level)]->Add(node, distance);
+		}
+		// else the bin is full, and the contact is dropped
+	}
+
+	void Split()
+	{
+		for (unsigned side = 0; side < 2; ++side) {
+			CUInt128 zoneIndex(m_zoneIndex);
+			zoneIndex <<= 1;
+			zoneIndex += side;
+			m_subZones[side] = new CSimRoutingZone(m_nodes, m_self, m_level + 1, zoneIndex);
+		}
+
+		std::vector<uint32> bin;
+		bin.swap(m_bin);
+		for (std::vector<uint32>::iterator it = bin.begin(); it != bin.end(); ++it) {
+			Add(*it, m_nodes[m_self].id ^ m_nodes[*it].id);
+		}
+	}
+
+	const SimNodes&		m_nodes;
+	uint32			m_self;
+	unsigned		m_level;
+	CUInt128		m_zoneIndex;
+	std::vector<uint32>	m_bin;
+	CSimRoutingZone*	m_subZones[2];
+};
+
+
+enum SimPacketType {
+	PACKET_REQ,		// KADEMLIA2_REQ
+	PACKET_RES,		// KADEMLIA2_RES
+	PACKET_SEARCH_REQ,	// KADEMLIA2_SEARCH_SOURCE_REQ
+	PACKET_SEARCH_RES,	// KADEMLIA2_SEARCH_RES
+	PACKET_PUBLISH_REQ,	// KADEMLIA2_PUBLISH_SOURCE_REQ
+	PACKET_PUBLISH_RES	// KADEMLIA2_PUBLISH_RES
+};
+
+
+struct SimPacket
+{
+	uint32		deliverAt;
+	uint32		sequence;	// keeps packets with the same delivery time in order
+	SimPacketType	type;
+	uint32		from;
+	uint32		to;
+	uint32		search;
+	uint8		contactCount;
+	CUInt128	target;
+	std::vector<uint32> contacts;
+	uint32		sources;
+
+	bool operator>(const SimPacket& other) const
+	{
+		return deliverAt != other.deliverAt ? deliverAt > other.deliverAt : sequence > other.sequence;
+	}
+};
+
+
+/**
+ * Delivers packets between the nodes, with their latency and the loss rate.
+ */
+class CSimNetwork
+{
+public:
+	CSimNetwork(SimNodes& nodes, uint32 lossPercent)
+		: m_nodes(nodes), m_lossPercent(lossPercent), m_sequence(0), m_sent(0), m_lost(0) {}
+
+	void Send(SimPacket& packet, uint32 now)
+	{
+		++m_sent;
+		if (NextRandom() % 100 < m_lossPercent || m_nodes[packet.to].dead) {
+			++m_lost;
+			return;
+		}
+		packet.deliverAt = now + m_nodes[packet.from].latency + m_nodes[packet.to].latency;
+		packet.sequence = m_sequence++;
+		m_queue.push(packet);
+	}
+
+	bool HasPacket() const		{ return !m_queue.empty(); }
+	uint32 GetNextDelivery() const	{ return m_queue.top().deliverAt; }
+
+	SimPacket Receive()
+	{
+		SimPacket packet = m_queue.top();
+		m_queue.pop();
+		return packet;
+	}
+
+	uint64 GetSent() const		{ return m_sent; }
+	uint64 GetLost() const		{ return m_lost; }
+
+private:
+	typedef std::priority_queue<SimPacket, std::vector<SimPacket>, std::greater<SimPacket> > PacketQueue;
+
+	SimNodes&	m_nodes;
+	uint32		m_lossPercent;
+	uint32		m_sequence;
+	uint64		m_sent;
+	uint64		m_lost;
+	PacketQueue	m_queue;
+};
+
+
+/**
+ * One lookup, following the steps of CSearch. Only FIND and STORE lookups
+ * are simulated, so the node lookups that CSearch::FillRequests() leaves
+ * alone do not show up here.
+ */
+class CSimSearch
+{
+public:
+	enum Type { FIND, STORE };
+	enum Mode {
+		BASELINE,	// only the jumpstart replaces lost requests
+		ADAPTIVE	// timed out requests are replaced, see CSearch::FillRequests()
+	};
+
+	CSimSearch(CSimNetwork& network, SimNodes& nodes, CRequestTimeout& timeout, Mode mode, uint32 id, Type type, uint32 origin, const CUInt128& target, uint32 closest, uint32 now)
+		: m_network(network), m_nodes(nodes), m_timeout(timeout), m_mode(mode), m_id(id), m_type(type), m_origin(origin), m_target(target),
+		  m_closest(closest), m_created(now), m_lastResponse(now), m_firstResult(0), m_closestFound(0), m_closestHops(0),
+		  m_answers(0), m_requests(0), m_stopping(false)
+	{
+	}
+
+	void Go(uint32 now)
+	{
+		CUInt128 distance(m_nodes[m_origin].id ^ m_target);
+		m_nodes[m_origin].routing->GetClosestTo(m_target, distance, 50, m_possible);
+		for (SimContactMap::iterator it = m_possible.begin(); it != m_possible.end(); ++it) {
+			m_hops[it->first] = 1;
+		}
+
+		SimContactMap::iterator it = m_possible.begin();
+		for (int i = 0; i < ALPHA_QUERY && it != m_possible.end(); ++i, ++it) {
+			m_tried[it->first] = it->second;
+			SendFindValue(it->second, now);
+		}
+	}
+
+	void FillRequests(uint32 now)
+	{
+		if (m_mode == BASELINE || m_stopping) {
+			return;
+		}
+
+		ExpireRequests(now);
+
+		// Once ALPHA_QUERY contacts answered, only closer ones are asked
+		const CUInt128* closerThan = NULL;
+		if (m_responded.size() >= ALPHA_QUERY) {
+			std::map<CUInt128, bool>::const_iterator responder = m_responded.begin();
+			for (int i = 1; i < ALPHA_QUERY; ++i) {
+				++responder;
+			}
+			closerThan = &responder->first;
+		}
+
+		const uint32 parallelism = m_timeout.GetParallelism();
+		SimContactMap::iterator it = m_possible.begin();
+		while (it != m_possible.end() && m_pending.size() < parallelism) {
+			if (closerThan != NULL && !(it->first < *closerThan)) {
+				break;
+			}
+			if (m_tried.count(it->first) == 0) {
+				m_tried[it->first] = it->second;
+				SendFindValue(it->second, now);
+			}
+			++it;
+		}
+	}
+
+	void JumpStart(uint32 now)
+	{
+		FillRequests(now);
+
+		if (m_lastResponse + SEC2MS(3) > now) {
+			return;
+		}
+
+		if (m_possible.empty()) {
+			m_stopping = true;
+			return;
+		}
+
+		while (!m_possible.empty()) {
+			SimContactMap::iterator best = m_possible.begin();
+			if (m_tried.count(best->first) > 0) {
+				if (m_responded.count(best->first) > 0) {
+					StorePacket(best->first, best->second, now);
+				}
+				m_possible.erase(best);
+			} else {
+				m_tried[best->first] = best->second;
+				SendFindValue(best->second, now);
+				break;
+			}
+		}
+	}
+
+	void ProcessResponse(const SimPacket& packet, uint32 now)
+	{
+		m_lastResponse = now;
+
+		CUInt128 fromDistance(m_nodes[packet.from].id ^ m_target);
+		if (m_tried.count(fromDistance) == 0) {
+			return;
+		}
+
+		RequestTimeMap::iterator pending = m_pending.find(fromDistance);
+		if (pending != m_pending.end()) {
+			if (m_mode == ADAPTIVE) {
+				m_timeout.AddRTT(now - pending->second);
+				m_timeout.AddAnswered();
+			}
+			m_pending.erase(pending);
+		} else {
+			pending = m_expired.find(fromDistance);
+			if (pending != m_expired.end()) {
+				m_timeout.AddRTT(now - pending->second);
+				m_expired.erase(pending);
+			}
+		}
+
+		if (packet.from == m_closest && m_closestFound == 0) {
+			m_closestFound = now;
+			m_closestHops = m_hops[fromDistance];
+		}
+
+		bool providedCloserContacts = false;
+		for (std::vector<uint32>::const_iterator it = packet.contacts.begin(); it != packet.contacts.end(); ++it) {
+			CUInt128 distance(m_nodes[*it].id ^ m_target);
+			if (distance < fromDistance) {
+				providedCloserContacts = true;
+			}
+			if (m_possible.count(distance) > 0 || m_tried.count(distance) > 0) {
+				continue;
+			}
+
+			m_possible[distance] = *it;
+			m_hops[distance] = m_hops[fromDistance] + 1;
+
+			if (distance < fromDistance) {
+				bool top = false;
+				if (m_best.size() < ALPHA_QUERY) {
+					top = true;
+					m_best[distance] = *it;
+				} else {
+					SimContactMap::iterator worst = --m_best.end();
+					if (distance < worst->first) {
+						m_best.erase(worst);
+						m_best[distance] = *it;
+						top = true;
+					}
+				}
+
+				if (top) {
+					m_tried[distance] = *it;
+					SendFindValue(*it, now);
+				}
+			}
+		}
+
+		m_responded[fromDistance] = providedCloserContacts;
+		FillRequests(now);
+	}
+
+	void ProcessResult(const SimPacket& packet, uint32 now)
+	{
+		if (packet.type == PACKET_SEARCH_RES && packet.sources == 0) {
+			return;
+		}
+		if (m_firstResult == 0) {
+			m_firstResult = now;
+		}
+		if (++m_answers >= (m_type == FIND ? SEARCHFILE_TOTAL : SEARCHSTOREFILE_TOTAL)) {
+			m_stopping = true;
+		}
+	}
+
+	bool IsFinished(uint32 now) const
+	{
+		return m_stopping || now - m_created >= SEC2MS(m_type == FIND ? SEARCHFILE_LIFETIME : SEARCHSTOREFILE_LIFETIME);
+	}
+
+	Type	GetType() const		{ return m_type; }
+	uint32	GetRequests() const	{ return m_requests; }
+	uint32	GetAnswers() const	{ return m_answers; }
+	// Times from the start of the lookup, 0 if it never got there
+	uint32	GetFirstResultTime() const	{ return m_firstResult ? m_firstResult - m_created : 0; }
+	uint32	GetClosestTime() const		{ return m_closestFound ? m_closestFound - m_created : 0; }
+	uint32	GetClosestHops() const		{ return m_closestHops; }
+
+private:
+	typedef std::map<CUInt128, uint32> RequestTimeMap;
+	typedef std::map<CUInt128, uint32> HopMap;
+
+	void ExpireRequests(uint32 now)
+	{
+		const uint32 timeout = m_timeout.GetTimeout();
+		RequestTimeMap::iterator it = m_pending.begin();
+		while (it != m_pending.end()) {
+			if (now - it->second >= timeout) {
+				m_timeout.AddExpired();
+				m_expired.insert(*it);
+				m_pending.erase(it++);
+			} else {
+				++it;
+			}
+		}
+	}
+
+	void Send(SimPacketType type, uint32 to, uint32 now)
+	{
+		SimPacket packet;
+		packet.type = type;
+		packet.from = m_origin;
+		packet.to = to;
+		packet.search = m_id;
+		packet.target = m_target;
+		packet.contactCount = m_type == FIND ? KADEMLIA_FIND_VALUE : KADEMLIA_STORE;
+		packet.sources = 0;
+		m_network.Send(packet, now);
+		++m_requests;
+	}
+
+	void SendFindValue(uint32 contact, uint32 now)
+	{
+		if (!m_stopping) {
+			Send(PACKET_REQ, contact, now);
+			m_pending[m_nodes[contact].id ^ m_target] = now;
+		}
+	}
+
+	void StorePacket(const CUInt128& distance, uint32 contact, uint32 now)
+	{
+		if (distance.Get32BitChunk(0) > SEARCHTOLERANCE) {
+			return;
+		}
+		Send(m_type == FIND ? PACKET_SEARCH_REQ : PACKET_PUBLISH_REQ, contact, now);
+	}
+
+	CSimNetwork&		m_network;
+	SimNodes&		m_nodes;
+	CRequestTimeout&	m_timeout;
+	Mode			m_mode;
+	uint32			m_id;
+	Type			m_type;
+	uint32			m_origin;
+	CUInt128		m_target;
+	uint32			m_closest;
+	uint32			m_created;
+	uint32			m_lastResponse;
+	uint32			m_firstResult;
+	uint32			m_closestFound;
+	uint32			m_closestHops;
+	uint32			m_answers;
+	uint32			m_requests;
+	bool			m_stopping;
+
+	SimContactMap		m_possible;
+	SimContactMap		m_tried;
+	SimContactMap		m_best;
+	std::map<CUInt128, bool> m_responded;
+	RequestTimeMap		m_pending;
+	RequestTimeMap		m_expired;
+	HopMap			m_hops;
+};
+
+
+/**
+ * Stores a source in the index of a node like KADEMLIA2_PUBLISH_SOURCE_REQ
+ * does for a publisher that is not firewalled, and counts the memory the
+ * index allocates for it.
+ */
+static void StoreSource(SimNodes& nodes, uint32 node, uint32 publisher, const CUInt128& file)
+{
+	const uint64 bytes = s_allocatedBytes;
+	const uint64 blocks = s_allocatedBlocks;
+
+	CEntry* entry = new CEntry();
+	entry->m_uIP = publisher + 1;
+	entry->m_uTCPport = 4662;
+	entry->m_uUDPport = 4672;
+	entry->m_uKeyID = file;
+	entry->m_uSourceID = nodes[publisher].id;
+	entry->m_bSource = true;
+	entry->m_tLifeTime = time(NULL) + KADEMLIAREPUBLISHTIMES;
+	entry->AddTag(new CTagVarInt(TAG_SOURCEIP, entry->m_uIP));
+	entry->AddTag(new CTagInt8(TAG_SOURCETYPE, 1));
+	entry->AddTag(new CTagVarInt(TAG_SOURCEPORT, entry->m_uTCPport));
+	entry->AddTag(new CTagInt16(TAG_SOURCEUPORT, entry->m_uUDPport));
+	entry->AddTag(new CTagInt8(TAG_ENCRYPTION, 0));
+
+	uint8_t load;
+	if (!nodes[node].indexed->AddSources(file, entry->m_uSourceID, entry, load)) {
+		delete entry;
+	}
+
+	// Replacing a source can free more than it allocates, the sum is right anyway
+	nodes[node].indexBytes += s_allocatedBytes - bytes;
+	nodes[node].indexBlocks += s_allocatedBlocks - blocks;
+}
+
+
+/**
+ * What the receiving node does with a packet: answer requests from its
+ * routing table and index, and hand answers to the search they belong to.
+ */
+static void ProcessPacket(CSimNetwork& network, SimNodes& nodes, std::vector<CSimSearch*>& searches, const SimPacket& packet, uint32 now)
+{
+	SimNode& node = nodes[packet.to];
+	SimPacket answer;
+	answer.from = packet.to;
+	answer.to = packet.from;
+	answer.search = packet.search;
+	answer.target = packet.target;
+	answer.contactCount = 0;
+	answer.sources = 0;
+
+	switch (packet.type) {
+		case PACKET_REQ: {
+			SimContactMap closest;
+			node.routing->GetClosestTo(packet.target, node.id ^ packet.target, packet.contactCount, closest);
+			for (SimContactMap::iterator it = closest.begin(); it != closest.end(); ++it) {
+				answer.contacts.push_back(it->second);
+			}
+			answer.type = PACKET_RES;
+			network.Send(answer, now);
+			break;
+		}
+		case PACKET_SEARCH_REQ: {
+			std::map<CUInt128, uint32>::iterator it = node.index.find(packet.target);
+			answer.sources = it != node.index.end() ? it->second : 0;
+			answer.type = PACKET_SEARCH_RES;
+			network.Send(answer, now);
+			break;
+		}
+		case PACKET_PUBLISH_REQ:
+			node.index[packet.target]++;
+			StoreSource(nodes, packet.to, packet.from, packet.target);
+			answer.type = PACKET_PUBLISH_RES;
+			network.Send(answer, now);
+			break;
+		case PACKET_RES:
+			if (searches[packet.search]) {
+				searches[packet.search]->ProcessResponse(packet, now);
+			}
+			break;
+		case PACKET_SEARCH_RES:
+		case PACKET_PUBLISH_RES:
+			if (searches[packet.search]) {
+				searches[packet.search]->ProcessResult(packet, now);
+			}
+			break;
+	}
+}
+
+
+static uint32 FindClosestLiveNode(const SimNodes& nodes, const CUInt128& target)
+{
+	uint32 closest = 0;
+	CUInt128 closestDistance(true);
+	for (uint32 i = 0; i < nodes.size(); ++i) {
+		if (!nodes[i].dead && (nodes[i].id ^ target) < closestDistance) {
+			closestDistance = nodes[i].id ^ target;
+			closest = i;
+		}
+	}
+	return closest;
+}
+
+
+struct SimResults
+{
+	std::vector<uint32>	closestTimes;
+	std::vector<uint32>	closestHops;
+	std::vector<uint32>	firstResultTimes;
+	uint64			requests;
+	uint32			failed;
+
+	SimResults() : requests(0), failed(0) {}
+};
+
+
+static uint32 Percentile(std::vector<uint32> values, unsigned percent)
+{
+	if (values.empty()) {
+		return 0;
+	}
+	std::vector<uint32>::iterator nth = values.begin() + (values.size() - 1) * percent / 100;
+	std::nth_element(values.begin(), nth, values.end());
+	return *nth;
+}
+
+
+// How often the core timer replaces the timed out requests, see amule.h
+static const uint32 CORE_TIMER_PERIOD = 300;
+
+
+/**
+ * Runs one search for each target, starting a new one every 100ms, until all of them finished.
+ */
+static SimResults RunSearches(CSimNetwork& network, SimNodes& nodes, CRequestTimeout& timeout, CSimSearch::Mode mode, CSimSearch::Type type, const std::vector<CUInt128>& targets, uint32& now)
+{
+	SimResults results;
+	std::vector<CSimSearch*> searches(targets.size(), (CSimSearch*)NULL);
+	uint32 started = 0;
+	uint32 active = 0;
+	uint32 nextStart = now;
+	uint32 nextJumpStart = now + SEC2MS(SEARCH_JUMPSTART);
+	uint32 nextFill = now + CORE_TIMER_PERIOD;
+
+	while (started < targets.size() || active > 0) {
+		uint32 next = std::min(nextJumpStart, nextFill);
+		if (started < targets.size()) {
+			next = std::min(next, nextStart);
+		}
+		if (network.HasPacket()) {
+			next = std::min(next, network.GetNextDelivery());
+		}
+		now = next;
+
+		if (network.HasPacket() && network.GetNextDelivery() == now) {
+			ProcessPacket(network, nodes, searches, network.Receive(), now);
+		} else if (started < targets.size() && nextStart == now) {
+			uint32 origin;
+			do {
+				origin = NextRandom() % nodes.size();
+			} while (nodes[origin].dead);
+			const CUInt128& target = targets[started];
+			searches[started] = new CSimSearch(network, nodes, timeout, mode, started, type, origin, target, FindClosestLiveNode(nodes, target), now);
+			searches[started]->Go(now);
+			++started;
+			++active;
+			nextStart = now + 100;
+		} else if (nextJumpStart == now) {
+			for (uint32 i = 0; i < started; ++i) {
+				CSimSearch* search = searches[i];
+				if (search == NULL) {
+					continue;
+				}
+				if (search->IsFinished(now)) {
+					results.requests += search->GetRequests();
+					if (search->GetClosestTime()) {
+						results.closestTimes.push_back(search->GetClosestTime());
+						results.closestHops.push_back(search->GetClosestHops());
+					} else {
+						++results.failed;
+					}
+					if (search->GetFirstResultTime()) {
+						results.firstResultTimes.push_back(search->GetFirstResultTime());
+					}
+					delete search;
+					searches[i] = NULL;
+					--active;
+				} else {
+					search->JumpStart(now);
+				}
+			}
+			nextJumpStart = now + SEC2MS(SEARCH_JUMPSTART);
+		} else {
+			// CSearchManager::ExpireRequests()
+			for (uint32 i = 0; i < started; ++i) {
+				if (searches[i]) {
+					searches[i]->FillRequests(now);
+				}
+			}
+			nextFill = now + CORE_TIMER_PERIOD;
+		}
+	}
+
+	// Drop the answers that came too late
+	while (network.HasPacket()) {
+		network.Receive();
+	}
+
+	return results;
+}
+
+
+static void PrintResults(const char* name, const SimResults& results, CSimSearch::Mode mode, const CRequestTimeout& timeout, uint32 count, double cpuTime)
+{
+	printf("%s: %u lookups, %u did not reach the closest node\n", name, count, results.failed);
+	printf("  hops to the closest node:  median %u, 90%% %u\n", Percentile(results.closestHops, 50), Percentile(results.closestHops, 90));
+	printf("  time to the closest node:  median %ums, 90%% %ums\n", Percentile(results.closestTimes, 50), Percentile(results.closestTimes, 90));
+	printf("  time to the first result:  median %ums, 90%% %ums (%u lookups with results)\n",
+		Percentile(results.firstResultTimes, 50), Percentile(results.firstResultTimes, 90), (uint32)results.firstResultTimes.size());
+	printf("  requests sent per lookup:  %.1f\n", count ? (double)results.requests / count : 0.0);
+	if (mode == CSimSearch::ADAPTIVE) {
+		printf("  at the end:                %ums timeout, %.1f%% answered in time, %u requests in flight\n",
+			timeout.GetTimeout(), timeout.GetResponseRate() / 10.0, timeout.GetParallelism());
+	}
+	printf("  CPU time per lookup:       %.3fms\n", count ? cpuTime * 1000 / count : 0.0);
+}
+
+
+/**
+ * Publishes a source for each target and looks them up again with one kind
+ * of lookups, on empty indexes, and prints what it cost. Returns the
+ * results of the lookups that searched for the sources.
+ */
+static SimResults RunLookups(SimNodes& nodes, CSimSearch::Mode mode, const std::vector<CUInt128>& targets, uint32 lossPercent)
+{
+	const uint32 nodeCount = nodes.size();
+	const uint32 lookups = targets.size();
+
+	for (uint32 i = 0; i < nodeCount; ++i) {
+		nodes[i].index.clear();
+
+		const uint64 bytes = s_allocatedBytes;
+		const uint64 blocks = s_allocatedBlocks;
+		nodes[i].indexed = new CIndexed(wxEmptyString);
+		nodes[i].indexBytes = s_allocatedBytes - bytes;
+		nodes[i].indexBlocks = s_allocatedBlocks - blocks;
+	}
+
+	printf("\n%s lookups\n", mode == CSimSearch::BASELINE ? "baseline" : "adaptive");
+
+	CSimNetwork network(nodes, lossPercent);
+	CRequestTimeout timeout;
+	uint32 now = 0;
+
+	clock_t start = clock();
+	SimResults published = RunSearches(network, nodes, timeout, mode, CSimSearch::STORE, targets, now);
+	PrintResults("publish", published, mode, timeout, lookups, (double)(clock() - start) / CLOCKS_PER_SEC);
+	uint64 publishPackets = network.GetSent();
+
+	start = clock();
+	SimResults found = RunSearches(network, nodes, timeout, mode, CSimSearch::FIND, targets, now);
+	PrintResults("find", found, mode, timeout, lookups, (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	uint64 sources = 0;
+	uint32 maxSources = 0;
+	uint64 indexBytes = 0;
+	uint64 indexBlocks = 0;
+	uint64 maxIndexBytes = 0;
+	for (uint32 i = 0; i < nodeCount; ++i) {
+		sources += nodes[i].indexed->m_totalIndexSource;
+		maxSources = std::max<uint32>(maxSources, nodes[i].indexed->m_totalIndexSource);
+		indexBytes += nodes[i].indexBytes;
+		indexBlocks += nodes[i].indexBlocks;
+		maxIndexBytes = std::max(maxIndexBytes, nodes[i].indexBytes);
+	}
+	printf("index: %llu sources, %u on the busiest node\n", (unsigned long long)sources, maxSources);
+	printf("  allocated by CIndexed:     %llu bytes in %llu blocks, %.0f bytes per source, %llu bytes on the busiest node\n",
+		(unsigned long long)indexBytes, (unsigned long long)indexBlocks, sources ? (double)indexBytes / sources : 0.0,
+		(unsigned long long)maxIndexBytes);
+	printf("packets: %llu sent (%llu publishing), %llu lost or sent to dead nodes\n",
+		(unsigned long long)network.GetSent(), (unsigned long long)publishPackets, (unsigned long long)network.GetLost());
+
+	for (uint32 i = 0; i < nodeCount; ++i) {
+		delete nodes[i].indexed;
+		nodes[i].indexed = NULL;
+	}
+
+	return found;
+}
+
+
+int main(int argc, char* argv[])
+{
+	uint32 nodeCount = argc > 1 ? strtoul(argv[1], NULL, 10) : 5000;
+	uint32 lookups = argc > 2 ? strtoul(argv[2], NULL, 10) : 500;
+	uint32 lossPercent = argc > 3 ? strtoul(argv[3], NULL, 10) : 5;
+	uint32 deadPercent = argc > 4 ? strtoul(argv[4], NULL, 10) : 10;
+	uint32 minLatency = argc > 5 ? strtoul(argv[5], NULL, 10) : 20;
+	uint32 maxLatency = argc > 6 ? strtoul(argv[6], NULL, 10) : 300;
+
+	if (nodeCount < 2 || lossPercent > 100 || deadPercent >= 100 || minLatency > maxLatency) {
+		fprintf(stderr, "Usage: %s [nodes] [lookups] [loss %%] [dead %%] [min latency ms] [max latency ms]\n", argv[0]);
+		return 1;
+	}
+
+	SimNodes nodes(nodeCount);
+	for (uint32 i = 0; i < nodeCount; ++i) {
+		nodes[i].id = RandomID();
+		nodes[i].latency = NextRandom(minLatency, maxLatency) / 2;
+		nodes[i].dead = NextRandom() % 100 < deadPercent;
+	}
+
+	// Fill the routing tables. Every node has heard of a random part of the
+	// network, and knows its neighbourhood well, like after a few hours of
+	// uptime. Dead nodes stay in the tables, as stale contacts do.
+	clock_t start = clock();
+	std::vector<std::pair<CUInt128, uint32> > sorted;
+	for (uint32 i = 0; i < nodeCount; ++i) {
+		sorted.push_back(std::make_pair(nodes[i].id, i));
+	}
+	std::sort(sorted.begin(), sorted.end());
+
+	uint64 contacts = 0;
+	for (uint32 i = 0; i < nodeCount; ++i) {
+		uint32 self = sorted[i].second;
+		nodes[self].routing = new CSimRoutingZone(nodes, self);
+		for (uint32 j = 0; j < std::min<uint32>(nodeCount, 2000); ++j) {
+			nodes[self].routing->Add(NextRandom() % nodeCount);
+		}
+		for (uint32 j = i > 32 ? i - 32 : 0; j < std::min<uint32>(nodeCount, i + 33); ++j) {
+			nodes[self].routing->Add(sorted[j].second);
+		}
+		contacts += nodes[self].routing->GetNumContacts();
+	}
+	printf("%u nodes (%u%% dead), %.1f contacts per routing table, set up in %.3fs\n",
+		nodeCount, deadPercent, (double)contacts / nodeCount, (double)(clock() - start) / CLOCKS_PER_SEC);
+	printf("%u%% packet loss, %u-%ums round trip\n", lossPercent, minLatency, maxLatency);
+
+	std::vector<CUInt128> targets;
+	for (uint32 i = 0; i < lookups; ++i) {
+		targets.push_back(RandomID());
+	}
+
+	// Both kinds of lookups start from the same nodes and lose the same packets
+	const uint32 randomState = s_randomState;
+	SimResults baseline = RunLookups(nodes, CSimSearch::BASELINE, targets, lossPercent);
+	s_randomState = randomState;
+	SimResults adaptive = RunLookups(nodes, CSimSearch::ADAPTIVE, targets, lossPercent);
+
+	const double baselineRequests = lookups ? (double)baseline.requests / lookups : 0.0;
+	const double adaptiveRequests = lookups ? (double)adaptive.requests / lookups : 0.0;
+	printf("\nadaptive find lookups compared with baseline\n");
+	printf("  requests sent per lookup:  %.1f instead of %.1f (%+.0f%%)\n", adaptiveRequests, baselineRequests,
+		baselineRequests > 0 ? (adaptiveRequests / baselineRequests - 1) * 100 : 0.0);
+	printf("  time to the first result:  median %ums instead of %ums, 90%% %ums instead of %ums\n",
+		Percentile(adaptive.firstResultTimes, 50), Percentile(baseline.firstResultTimes, 50),
+		Percentile(adaptive.firstResultTimes, 90), Percentile(baseline.firstResultTimes, 90));
+
+	for (uint32 i = 0; i < nodeCount; ++i) {
+		delete nodes[i].routing;
+	}
+
+	return 0;
+}
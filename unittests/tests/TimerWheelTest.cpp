@@ -0,0 +1,114 @@
+#include <muleunit/test.h>
+#include <algorithm>
+#include "TimerWheel.h"
+
+using namespace muleunit;
+
+
+DECLARE_SIMPLE(TimerWheel);
+
+
+// Returns the values that are due at 'now', sorted
+std::vector<int> Expire(CTimerWheel<int>& wheel, uint32 now)
+{
+	std::vector<int> due;
+	wheel.Expire(now, due);
+	std::sort(due.begin(), due.end());
+	return due;
+}
+
+
+TEST(TimerWheel, Empty)
+{
+	CTimerWheel<int> wheel(100, 1000);
+
+	ASSERT_TRUE(wheel.empty());
+	ASSERT_EQUALS(0u, Expire(wheel, 1000).size());
+	ASSERT_EQUALS(0u, Expire(wheel, 1000000).size());
+}
+
+
+TEST(TimerWheel, NotEarly)
+{
+	CTimerWheel<int> wheel(100, 1000);
+
+	wheel.Add(1, 1250);
+	wheel.Add(2, 1300);
+	ASSERT_EQUALS(2u, wheel.size());
+
+	ASSERT_EQUALS(0u, Expire(wheel, 1249).size());
+
+	// Deadlines are rounded up to the next tick
+	ASSERT_EQUALS(0u, Expire(wheel, 1299).size());
+	std::vector<int> due = Expire(wheel, 1300);
+	ASSERT_EQUALS(2u, due.size());
+	ASSERT_EQUALS(1, due[0]);
+	ASSERT_EQUALS(2, due[1]);
+	ASSERT_TRUE(wheel.empty());
+}
+
+
+TEST(TimerWheel, PastDeadline)
+{
+	CTimerWheel<int> wheel(100, 1000);
+
+	wheel.Add(1, 500);
+	wheel.Add(2, 1000);
+	ASSERT_EQUALS(0u, Expire(wheel, 1099).size());
+	ASSERT_EQUALS(2u, Expire(wheel, 1100).size());
+}
+
+
+TEST(TimerWheel, Cascade)
+{
+	CTimerWheel<int> wheel(1, 0);
+
+	// One value due on every tick across the first three wheels, added
+	// in reverse and collected in one go and tick by tick.
+	const int count = 64 * 64 * 3;
+	for (int i = count; i > 0; --i) {
+		wheel.Add(i, i);
+	}
+	ASSERT_EQUALS((size_t)count, wheel.size());
+
+	std::vector<int> due = Expire(wheel, 100);
+	ASSERT_EQUALS(100u, due.size());
+	for (int i = 0; i < 100; ++i) {
+		ASSERT_EQUALS(i + 1, due[i]);
+	}
+
+	for (int i = 101; i <= count; ++i) {
+		due = Expire(wheel, i);
+		ASSERT_EQUALS(1u, due.size());
+		ASSERT_EQUALS(i, due[0]);
+	}
+	ASSERT_TRUE(wheel.empty());
+}
+
+
+TEST(TimerWheel, LongDelays)
+{
+	CTimerWheel<int> wheel(1000, 0);
+
+	// Due on the last wheel, added later than the start
+	ASSERT_EQUALS(0u, Expire(wheel, 123000).size());
+	wheel.Add(1, 123000 + 1000 * 300000);
+	wheel.Add(2, 123000 + 1000 * 64 * 64);
+	ASSERT_EQUALS(0u, Expire(wheel, 123000 + 1000 * 64 * 64 - 1).size());
+	ASSERT_EQUALS(1u, Expire(wheel, 123000 + 1000 * 64 * 64 + 999).size());
+	ASSERT_EQUALS(0u, Expire(wheel, 123000 + 1000 * 299999).size());
+	std::vector<int> due = Expire(wheel, 123000 + 1000 * 300000);
+	ASSERT_EQUALS(1u, due.size());
+	ASSERT_EQUALS(1, due[0]);
+}
+
+
+TEST(TimerWheel, Wraparound)
+{
+	// GetTickCount() wraps around during the delay
+	CTimerWheel<int> wheel(16, 0xFFFFF000);
+
+	wheel.Add(1, 0x1000);
+	ASSERT_EQUALS(0u, Expire(wheel, 0x0FFF).size());
+	ASSERT_EQUALS(1u, Expire(wheel, 0x1000).size());
+}